@@ -0,0 +1,421 @@
+#pragma once
+#include <Arduino.h>
+#include <Ezo_i2c.h> //include the EZO I2C library from https://github.com/Atlas-Scientific/Ezo_I2c_lib
+#include "Devices.h"
+#include "ReadingSnapshot.h"
+#include "CommandQueue.h"
+#include "../SimpleWeb/Metrics.h"
+
+//percent of board responses replaced with NOT_READY, FAIL or NO_DATA to exercise the error handling on real hardware
+#ifndef SENSORS_FAULT_RATE
+#define SENSORS_FAULT_RATE 0
+#endif
+
+namespace Sensors
+{
+    enum Operation
+    {
+        OperationNone,
+        OperationRead,
+        OperationCommand
+    };
+
+    /*
+        One EZO circuit and the command it is currently processing.
+        The circuit can't be asked for anything else until the deadline passes.
+    */
+    struct Probe
+    {
+        Ezo_board* board;
+        Operation operation;
+        //a read is still owed for the current cycle
+        bool wanted;
+        unsigned long issuedAt;
+        unsigned long deadline;
+        uint8_t retries;
+        Ezo_board::errors error;
+        //since the first of a run of errors, for the recovery time
+        bool failing;
+        unsigned long failingSince;
+        //the queued command being processed when the operation is OperationCommand
+        Job* job;
+
+        Probe(Ezo_board& ezo) :
+            board(&ezo),
+            operation(OperationNone),
+            wanted(false),
+            issuedAt(0),
+            deadline(0),
+            retries(0),
+            error(Ezo_board::NO_DATA),
+            failing(false),
+            failingSince(0),
+            job(nullptr)
+        {
+        }
+
+        bool IsBusy() const { return operation != OperationNone; }
+    };
+
+    /*
+        Tick driven reader for the probes in the device registry.
+        Start() marks every probe as owing a reading and Tick() sends the commands, records when each
+        circuit will be done and collects whatever is ready, then returns straight away.
+        Nothing in here calls delay().
+
+        Probes are read at the same time since they are independent, except the ones that need the
+        temperature (PH). They are sent a combined read with temperature compensation (RT,n) as soon as
+        the temperature probe (RTD) answers.
+
+        This is the only thing that talks on the I2C bus. Commands from the web task come in through
+        the CommandQueue and are sent to a circuit whenever it isn't busy with a reading, so they
+        overlap with the reads of the other circuits. Boards that aren't probes (PMPL) only get commands.
+    */
+    class Acquisition
+    {
+        public:
+        //how long to wait for the response to any other command
+        static const unsigned long COMMAND_TIME = 1200;
+        //how long to wait before asking again when a circuit says it isn't ready
+        static const unsigned long RETRY_TIME = 50;
+        static const uint8_t MAX_RETRIES = 10;
+        //temperature sent to the PH circuit when the RTD reading is invalid
+        static constexpr float DEFAULT_TEMPERATURE = 25.0;
+
+        private:
+        //every board, the probes first
+        Probe _probes[DEVICE_COUNT];
+        CommandQueue& _commands;
+        bool _running;
+        //bit mask of SensorId read in the current cycle
+        uint8_t _sensors;
+        float _temperature;
+        unsigned long _startTime;
+        unsigned long _cycleTime;
+
+        //from sending a read to having the value, in milliseconds
+        SimpleWeb::Histogram _readTimes[SENSOR_COUNT];
+        SimpleWeb::Histogram _cycleTimes;
+        //anything other than SUCCESS from a board
+        SimpleWeb::Counter _errors[DEVICE_COUNT];
+        //NOT_READY answers that were asked again
+        SimpleWeb::Counter _retries[DEVICE_COUNT];
+        //time each board spent processing, its rate is how much of the time the board is busy
+        SimpleWeb::Counter _busyTime[DEVICE_COUNT];
+        //from a board's first error to its next success, in milliseconds
+        SimpleWeb::Histogram _recoveryTimes;
+        SimpleWeb::Counter _injected;
+
+        /*
+            Picks a fault to stand in for the board's response SENSORS_FAULT_RATE percent of the time.
+            It's decided before the board is read, so an injected NOT_READY leaves the response on the
+            board for the retry like a real one.
+            returns SUCCESS when the board should be read
+        */
+        Ezo_board::errors InjectFault()
+        {
+            static const Ezo_board::errors faults[] = {Ezo_board::NOT_READY, Ezo_board::FAIL, Ezo_board::NO_DATA};
+
+            if(SENSORS_FAULT_RATE == 0 || random(100) >= SENSORS_FAULT_RATE)
+                return Ezo_board::SUCCESS;
+
+            _injected.Increment();
+            return faults[random(3)];
+        }
+
+        /*
+            Keeps track of how long a board takes to come back after an error
+        */
+        void Recover(Probe& probe, Ezo_board::errors error, unsigned long now)
+        {
+            if(error != Ezo_board::SUCCESS)
+            {
+                if(!probe.failing)
+                {
+                    probe.failing = true;
+                    probe.failingSince = now;
+                }
+            }
+            else if(probe.failing)
+            {
+                probe.failing = false;
+                _recoveryTimes.Observe(now - probe.failingSince);
+            }
+        }
+
+        void Issue(Probe& probe, Operation operation, unsigned long now, unsigned long processingTime)
+        {
+            probe.operation = operation;
+            probe.issuedAt = now;
+            probe.retries = 0;
+            probe.deadline = now + processingTime;
+        }
+
+        /*
+            Sends the reading the probe owes for this cycle
+        */
+        void IssueRead(uint8_t sensor, unsigned long now)
+        {
+            Probe& probe = _probes[sensor];
+            const KindInfo& kind = Devices::KindOf(sensor);
+            probe.wanted = false;
+
+            //send a read command. we use this command instead of PH.send_cmd("RT,n");
+            //to let the library know to parse the reading
+            if(kind.Has(CapabilityCompensated))
+                probe.board->send_read_with_temp_comp(_temperature);
+            else
+                probe.board->send_read_cmd();
+
+            Issue(probe, OperationRead, now, kind.readTime);
+        }
+
+        /*
+            Compensated probes have to wait until the temperature of this cycle is in
+        */
+        bool CanRead(uint8_t sensor) const
+        {
+            if(!Devices::KindOf(sensor).Has(CapabilityCompensated))
+                return true;
+
+            for(uint8_t i = 0; i < SENSOR_COUNT; i++)
+            {
+                const Probe& probe = _probes[i];
+
+                if(Devices::KindOf(i).Has(CapabilityTemperature) && (probe.wanted || probe.operation == OperationRead))
+                    return false;
+            }
+
+            return true;
+        }
+
+        /*
+            Collects the response once the circuit should be done.
+            returns false when the circuit wasn't ready and will be asked again
+        */
+        bool Collect(uint8_t device, unsigned long now)
+        {
+            Probe& probe = _probes[device];
+            Ezo_board::errors error = InjectFault();
+
+            if(error == Ezo_board::SUCCESS)
+            {
+                if(probe.operation == OperationRead)
+                    error = probe.board->receive_read_cmd();
+                else
+                    error = probe.board->receive_cmd(probe.job->response, Job::COMMAND_SIZE);
+            }
+
+            if(error == Ezo_board::NOT_READY && probe.retries < MAX_RETRIES)
+            {
+                _retries[device].Increment();
+                probe.retries++;
+                probe.deadline = now + RETRY_TIME;
+                return false;
+            }
+
+            if(error != Ezo_board::SUCCESS)
+                _errors[device].Increment();
+
+            _busyTime[device].Increment(now - probe.issuedAt);
+            Recover(probe, error, now);
+
+            if(probe.operation == OperationCommand)
+            {
+                Serial.printf("%s: %s -> %s\n", probe.board->get_name(), probe.job->command, probe.job->response);
+                _commands.Complete(*probe.job, error);
+                probe.job = nullptr;
+                probe.operation = OperationNone;
+                return true;
+            }
+
+            probe.operation = OperationNone;
+            probe.error = error;
+            _readTimes[device].Observe(now - probe.issuedAt);
+
+            if(error == Ezo_board::SUCCESS)
+                Serial.printf("%s: %.2f\n", probe.board->get_name(), probe.board->get_last_received_reading());
+            else
+                Serial.printf("%s: error %i\n", probe.board->get_name(), error);
+
+            if(Devices::KindOf(device).Has(CapabilityTemperature))
+            {
+                if((error == Ezo_board::SUCCESS) && (probe.board->get_last_received_reading() > -1000.0))
+                    _temperature = probe.board->get_last_received_reading();
+                else
+                    _temperature = DEFAULT_TEMPERATURE;
+            }
+
+            return true;
+        }
+
+        public:
+        #define SENSORS_DEVICE_PROBE(name, address, pin, level, kind) Probe(Devices::Board(DEVICE_##name)),
+
+        Acquisition(CommandQueue& commands) :
+            _probes { SENSORS_DEVICES(SENSORS_DEVICE_PROBE) },
+            _commands(commands),
+            _running(false),
+            _sensors(0),
+            _temperature(DEFAULT_TEMPERATURE),
+            _startTime(0),
+            _cycleTime(0)
+        {
+            //read and cycle time buckets in milliseconds
+            static const uint32_t bounds[] = {250, 500, 750, 1000, 1250, 1500, 2000, 3000, 5000};
+
+            for(uint8_t i = 0; i < SENSOR_COUNT; i++)
+                _readTimes[i].SetBounds(bounds);
+
+            _cycleTimes.SetBounds(bounds);
+
+            static const uint32_t recoveryBounds[] = {100, 500, 1000, 5000, 15000, 60000, 300000, 900000, 3600000};
+            _recoveryTimes.SetBounds(recoveryBounds);
+        }
+
+        #undef SENSORS_DEVICE_PROBE
+
+        /*
+            Starts a new cycle for the probes in the bit mask of SensorId, see Scheduler. Does nothing if one is already running.
+            The reads go out on the next Tick() for every circuit that isn't busy with a command.
+        */
+        void Start(unsigned long now, uint8_t sensors)
+        {
+            if(_running)
+                return;
+
+            _running = true;
+            _sensors = sensors;
+            _startTime = now;
+
+            for(uint8_t i = 0; i < SENSOR_COUNT; i++)
+                _probes[i].wanted = (sensors & (1 << i)) != 0;
+        }
+
+        /*
+            Advances the cycle and the queued commands without blocking.
+            returns true on the tick the cycle completes
+        */
+        bool Tick(unsigned long now)
+        {
+            for(uint8_t i = 0; i < DEVICE_COUNT; i++)
+            {
+                Probe& probe = _probes[i];
+
+                if(probe.IsBusy() && (long)(now - probe.deadline) >= 0)
+                    Collect(i, now);
+            }
+
+            //everything has been collected first, so the temperature is in by the time the compensated probes are looked at
+            for(uint8_t device = 0; device < DEVICE_COUNT; device++)
+            {
+                Probe& probe = _probes[device];
+
+                if(probe.IsBusy())
+                    continue;
+
+                if(probe.wanted)
+                {
+                    if(CanRead(device))
+                        IssueRead(device, now);
+
+                    continue;
+                }
+
+                Job* job = _commands.Next(device);
+
+                if(job != nullptr)
+                {
+                    Serial.printf("Sending command=%s\n", job->command);
+                    probe.board->send_cmd(job->command);
+                    probe.job = job;
+                    Issue(probe, OperationCommand, now, COMMAND_TIME);
+                }
+            }
+
+            if(!_running)
+                return false;
+
+            for(uint8_t i = 0; i < SENSOR_COUNT; i++)
+            {
+                if(_probes[i].wanted || _probes[i].operation == OperationRead)
+                    return false;
+            }
+
+            _running = false;
+            _cycleTime = now - _startTime;
+            _cycleTimes.Observe(_cycleTime);
+            return true;
+        }
+
+        /*
+            Copies the last value and error of every probe, the ones that weren't read in the last cycle
+            keep what they had and are left out of sampled. The caller fills in the rest.
+        */
+        void GetReadings(ReadingSnapshot& snapshot)
+        {
+            snapshot.sampled = _sensors;
+
+            for(uint8_t i = 0; i < SENSOR_COUNT; i++)
+            {
+                snapshot.values[i] = _probes[i].board->get_last_received_reading();
+                snapshot.errors[i] = _probes[i].error;
+            }
+        }
+
+        /*
+            Writes the read times, cycle times, I2C errors and how busy each board is in the Prometheus text format
+        */
+        void WriteMetrics(Print& out)
+        {
+            char labels[24];
+
+            out.println("# TYPE ezo_read_duration_milliseconds histogram");
+
+            for(uint8_t i = 0; i < SENSOR_COUNT; i++)
+            {
+                snprintf(labels, sizeof(labels), "device=\"%s\"", _probes[i].board->get_name());
+                _readTimes[i].Write(out, "ezo_read_duration_milliseconds", labels);
+            }
+
+            out.println("# TYPE ezo_errors_total counter");
+
+            for(uint8_t i = 0; i < DEVICE_COUNT; i++)
+                SimpleWeb::Printf(out, "ezo_errors_total{device=\"%s\"} %u\n", _probes[i].board->get_name(), (unsigned int)_errors[i].Value());
+
+            out.println("# TYPE ezo_not_ready_total counter");
+
+            for(uint8_t i = 0; i < DEVICE_COUNT; i++)
+                SimpleWeb::Printf(out, "ezo_not_ready_total{device=\"%s\"} %u\n", _probes[i].board->get_name(), (unsigned int)_retries[i].Value());
+
+            out.println("# TYPE ezo_busy_milliseconds_total counter");
+
+            for(uint8_t i = 0; i < DEVICE_COUNT; i++)
+                SimpleWeb::Printf(out, "ezo_busy_milliseconds_total{device=\"%s\"} %u\n", _probes[i].board->get_name(), (unsigned int)_busyTime[i].Value());
+
+            out.println("# TYPE ezo_recovery_duration_milliseconds histogram");
+            _recoveryTimes.Write(out, "ezo_recovery_duration_milliseconds", "");
+
+            if(SENSORS_FAULT_RATE != 0)
+            {
+                out.println("# TYPE ezo_injected_faults_total counter");
+                SimpleWeb::Printf(out, "ezo_injected_faults_total %u\n", (unsigned int)_injected.Value());
+            }
+
+            out.println("# TYPE acquisition_cycle_duration_milliseconds histogram");
+            _cycleTimes.Write(out, "acquisition_cycle_duration_milliseconds", "");
+        }
+
+        bool IsRunning() const { return _running; }
+
+        /*
+            Temperature used to compensate the last PH reading
+        */
+        float Temperature() const { return _temperature; }
+
+        /*
+            How long the last complete cycle took in milliseconds
+        */
+        unsigned long CycleTime() const { return _cycleTime; }
+    };
+}
@@ -0,0 +1,233 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include "ReadingSnapshot.h"
+
+//how many commands can be queued or kept around for their result
+#ifndef SENSORS_COMMAND_QUEUE_SIZE
+#define SENSORS_COMMAND_QUEUE_SIZE 8
+#endif
+
+namespace Sensors
+{
+    enum JobStatus
+    {
+        JobFree,
+        //taken by Submit() and being rewritten, Find() skips it
+        JobFilling,
+        //filled in by the web task, waiting for the board to be free
+        JobQueued,
+        JobRunning,
+        //response is ready, the slot is reused once the queue runs out of free ones
+        JobDone
+    };
+
+    struct Job
+    {
+        static const size_t COMMAND_SIZE = 32;
+
+        //handed back and forth between the web task and the acquisition side
+        std::atomic<uint8_t> status;
+        uint32_t id;
+        uint8_t device;
+        char command[COMMAND_SIZE];
+        char response[COMMAND_SIZE];
+        //Ezo_board::errors from receiving the response
+        uint8_t error;
+    };
+
+    /*
+        Copy of a job that is safe to use on the web task
+    */
+    struct JobResult
+    {
+        uint32_t id;
+        uint8_t status;
+        uint8_t device;
+        char command[Job::COMMAND_SIZE];
+        char response[Job::COMMAND_SIZE];
+        uint8_t error;
+    };
+
+    /*
+        Bounded queue of EZO commands from the web task to the acquisition side.
+        Jobs are added by the web task and the dosing controller and run by the acquisition side only,
+        the status of each slot is what hands it over. A finished job is reused while Find() could be
+        copying it, so Find() checks the status and id again afterwards like a SeqLock read.
+    */
+    class CommandQueue
+    {
+        private:
+        Job _jobs[SENSORS_COMMAND_QUEUE_SIZE];
+        uint32_t _nextId;
+        //there is more than one task submitting, they take turns picking a slot
+        portMUX_TYPE _submitLock = portMUX_INITIALIZER_UNLOCKED;
+
+        public:
+        CommandQueue() : _nextId(1)
+        {
+            for(uint8_t i = 0; i < SENSORS_COMMAND_QUEUE_SIZE; i++)
+            {
+                _jobs[i].status.store(JobFree, std::memory_order_relaxed);
+                _jobs[i].id = 0;
+            }
+        }
+
+        /*
+            Queues a command. Can be called from any task.
+            returns the job id or 0 when the queue is full
+        */
+        uint32_t Submit(uint8_t device, const char* command)
+        {
+            Job* slot = nullptr;
+            portENTER_CRITICAL(&_submitLock);
+
+            for(uint8_t i = 0; i < SENSORS_COMMAND_QUEUE_SIZE; i++)
+            {
+                uint8_t status = _jobs[i].status.load(std::memory_order_acquire);
+
+                if(status == JobFree)
+                {
+                    slot = &_jobs[i];
+                    break;
+                }
+
+                //otherwise the oldest finished job makes room
+                if(status == JobDone && (slot == nullptr || _jobs[i].id < slot->id))
+                    slot = &_jobs[i];
+            }
+
+            if(slot == nullptr)
+            {
+                portEXIT_CRITICAL(&_submitLock);
+                return 0;
+            }
+
+            //anyone copying the old job sees this before any of the new one
+            slot->status.store(JobFilling, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            slot->id = _nextId++;
+            slot->device = device;
+            strncpy(slot->command, command, Job::COMMAND_SIZE - 1);
+            slot->command[Job::COMMAND_SIZE - 1] = '\0';
+            slot->response[0] = '\0';
+            slot->error = 0;
+            uint32_t id = slot->id;
+            slot->status.store(JobQueued, std::memory_order_release);
+            portEXIT_CRITICAL(&_submitLock);
+            return id;
+        }
+
+        /*
+            How many more jobs Submit() will take right now. Called from the web task.
+            The dosing controller can take one in between, so Submit() can still return 0.
+        */
+        uint8_t Available() const
+        {
+            uint8_t available = 0;
+
+            for(uint8_t i = 0; i < SENSORS_COMMAND_QUEUE_SIZE; i++)
+            {
+                uint8_t status = _jobs[i].status.load(std::memory_order_acquire);
+
+                if(status == JobFree || status == JobDone)
+                    available++;
+            }
+
+            return available;
+        }
+
+        /*
+            Looks up a job by id. Can be called from any task.
+            returns false when the job doesn't exist or has been replaced
+        */
+        bool Find(uint32_t id, JobResult& result) const
+        {
+            for(uint8_t i = 0; i < SENSORS_COMMAND_QUEUE_SIZE; i++)
+            {
+                const Job& job = _jobs[i];
+                uint8_t status = job.status.load(std::memory_order_acquire);
+
+                if(status == JobFree || status == JobFilling || job.id != id)
+                    continue;
+
+                result.id = id;
+                result.status = status;
+                result.device = job.device;
+                //copied whole and terminated, the slot can be rewritten while it's copied
+                memcpy(result.command, job.command, Job::COMMAND_SIZE);
+                result.command[Job::COMMAND_SIZE - 1] = '\0';
+
+                //the response is still being written until the job is done
+                if(status == JobDone)
+                {
+                    memcpy(result.response, job.response, Job::COMMAND_SIZE);
+                    result.response[Job::COMMAND_SIZE - 1] = '\0';
+                    result.error = job.error;
+                }
+                else
+                {
+                    result.response[0] = '\0';
+                    result.error = 0;
+                }
+
+                //Submit() took the slot for another job during the copy, this one has been replaced
+                std::atomic_thread_fence(std::memory_order_acquire);
+
+                if(job.status.load(std::memory_order_relaxed) == JobFilling || job.id != id)
+                    return false;
+
+                return true;
+            }
+
+            return false;
+        }
+
+        /*
+            Takes the oldest queued job for a device and marks it running. Called from the acquisition side.
+            returns nullptr when there is nothing for that device
+        */
+        Job* Next(uint8_t device)
+        {
+            Job* next = nullptr;
+
+            for(uint8_t i = 0; i < SENSORS_COMMAND_QUEUE_SIZE; i++)
+            {
+                Job& job = _jobs[i];
+
+                if(job.status.load(std::memory_order_acquire) != JobQueued || job.device != device)
+                    continue;
+
+                if(next == nullptr || job.id < next->id)
+                    next = &job;
+            }
+
+            if(next != nullptr)
+                next->status.store(JobRunning, std::memory_order_relaxed);
+
+            return next;
+        }
+
+        /*
+            Hands the response back to the web task. Called from the acquisition side.
+        */
+        void Complete(Job& job, uint8_t error)
+        {
+            job.error = error;
+            job.status.store(JobDone, std::memory_order_release);
+        }
+
+        static const char* StatusName(uint8_t status)
+        {
+            switch(status)
+            {
+                case JobFilling:
+                case JobQueued: return "queued";
+                case JobRunning: return "running";
+                case JobDone: return "done";
+                default: return "free";
+            }
+        }
+    };
+}
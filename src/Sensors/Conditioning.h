@@ -0,0 +1,238 @@
+#pragma once
+#include <Arduino.h>
+#include <math.h>
+#include "Devices.h"
+#include "ReadingSnapshot.h"
+#include "SeqLock.h"
+#include "../SimpleWeb/Metrics.h"
+
+//how many of the last reads each probe's median is taken over, odd so there is a middle
+#ifndef SENSORS_FILTER_WINDOW
+#define SENSORS_FILTER_WINDOW 5
+#endif
+
+//weight of a new read in the moving average
+#ifndef SENSORS_FILTER_ALPHA
+#define SENSORS_FILTER_ALPHA 0.3f
+#endif
+
+//robust z-score above which a read is thrown out
+#ifndef SENSORS_OUTLIER_THRESHOLD
+#define SENSORS_OUTLIER_THRESHOLD 3.5f
+#endif
+
+namespace Sensors
+{
+    static_assert(SENSORS_FILTER_WINDOW % 2 == 1, "the median window has to be odd");
+
+    /*
+        Where one probe's filter is at, all in the probe's units
+    */
+    struct SignalState
+    {
+        //last read as it came off the board, outlier or not
+        float raw;
+        float median;
+        //moving average of the reads that weren't thrown out, this is the value everything else uses
+        float filtered;
+        //since boot, over the reads that weren't thrown out
+        float mean;
+        float deviation;
+        float min;
+        float max;
+        uint32_t count;
+        uint32_t rejected;
+    };
+
+    struct ConditioningState
+    {
+        SignalState sensors[SENSOR_COUNT];
+    };
+
+    /*
+        Filters the reads of one probe in fixed memory, every read costs the same no matter how many came before.
+
+        A read is thrown out when its robust z-score 0.6745 * (x - median) / MAD against the last
+        SENSORS_FILTER_WINDOW reads is above SENSORS_OUTLIER_THRESHOLD and it's further from the median than
+        the kind's spike size, so a flat probe reading 7.00, 7.00, 7.01 doesn't throw out the 7.02.
+        Thrown out reads still go into the window, a real step change is taken once most of the window agrees with it.
+
+        The mean and deviation are kept with Welford's method so they don't lose precision after days of reads.
+    */
+    class SignalFilter
+    {
+        private:
+        float _window[SENSORS_FILTER_WINDOW];
+        uint8_t _next;
+        uint8_t _size;
+        SignalState _state;
+        //sum of squared differences from the mean, for Welford
+        double _m2;
+        double _mean;
+
+        /*
+            Median of the first count values, sorts them in place
+        */
+        static float Median(float* values, uint8_t count)
+        {
+            for(uint8_t i = 1; i < count; i++)
+            {
+                float value = values[i];
+                uint8_t j = i;
+
+                for(; j > 0 && values[j - 1] > value; j--)
+                    values[j] = values[j - 1];
+
+                values[j] = value;
+            }
+
+            return values[count / 2];
+        }
+
+        bool IsOutlier(float value, float spike) const
+        {
+            //too few reads to say what normal is
+            if(_size < 3)
+                return false;
+
+            float sorted[SENSORS_FILTER_WINDOW];
+            memcpy(sorted, _window, sizeof(sorted));
+            float median = Median(sorted, _size);
+            float distance = fabsf(value - median);
+
+            if(distance <= spike)
+                return false;
+
+            for(uint8_t i = 0; i < _size; i++)
+                sorted[i] = fabsf(sorted[i] - median);
+
+            float mad = Median(sorted, _size);
+
+            //more than half the window is the same value, anything past the spike size stands out
+            if(mad == 0)
+                return true;
+
+            return 0.6745f * distance / mad > SENSORS_OUTLIER_THRESHOLD;
+        }
+
+        public:
+        SignalFilter() : _next(0), _size(0), _m2(0), _mean(0)
+        {
+            memset(&_state, 0, sizeof(_state));
+        }
+
+        /*
+            Adds one read that came back without an error.
+            returns false when it was thrown out as an outlier
+        */
+        bool Add(float value, float spike)
+        {
+            bool outlier = IsOutlier(value, spike);
+
+            _window[_next] = value;
+            _next = (_next + 1) % SENSORS_FILTER_WINDOW;
+
+            if(_size < SENSORS_FILTER_WINDOW)
+                _size++;
+
+            float sorted[SENSORS_FILTER_WINDOW];
+            memcpy(sorted, _window, sizeof(sorted));
+            _state.raw = value;
+            _state.median = Median(sorted, _size);
+
+            if(outlier)
+            {
+                _state.rejected++;
+                return false;
+            }
+
+            _state.count++;
+
+            if(_state.count == 1)
+            {
+                _state.filtered = value;
+                _state.min = value;
+                _state.max = value;
+            }
+            else
+            {
+                _state.filtered += SENSORS_FILTER_ALPHA * (value - _state.filtered);
+                _state.min = value < _state.min ? value : _state.min;
+                _state.max = value > _state.max ? value : _state.max;
+            }
+
+            double delta = value - _mean;
+            _mean += delta / _state.count;
+            _m2 += delta * (value - _mean);
+            _state.mean = _mean;
+            _state.deviation = _state.count > 1 ? sqrt(_m2 / (_state.count - 1)) : 0;
+            return true;
+        }
+
+        bool HasValue() const
+        {
+            return _state.count > 0;
+        }
+
+        const SignalState& State() const
+        {
+            return _state;
+        }
+    };
+
+    /*
+        The conditioning stage between the acquisition and everything that uses a reading.
+        Only call Add() from the acquisition side, the state is handed to the web task through a SeqLock.
+    */
+    class Conditioning
+    {
+        private:
+        SignalFilter _filters[SENSOR_COUNT];
+        SeqLock<ConditioningState> _state;
+
+        public:
+        /*
+            Runs the reads of the probes in the bit mask through their filters and fills in snapshot.filtered
+            and snapshot.rejected. A probe that wasn't read, failed or was thrown out keeps its last filtered value.
+        */
+        void Add(uint8_t sensors, ReadingSnapshot& snapshot)
+        {
+            ConditioningState state;
+            snapshot.rejected = 0;
+
+            for(uint8_t i = 0; i < SENSOR_COUNT; i++)
+            {
+                if((sensors & (1 << i)) != 0 && snapshot.errors[i] == Ezo_board::SUCCESS)
+                {
+                    if(!_filters[i].Add(snapshot.values[i], Devices::KindOf(i).spike))
+                    {
+                        Serial.printf("%s: %.2f thrown out\n", Devices::Info(i).name, snapshot.values[i]);
+                        snapshot.rejected |= 1 << i;
+                    }
+                }
+
+                state.sensors[i] = _filters[i].State();
+                //nothing to filter yet, pass on what the board said
+                snapshot.filtered[i] = _filters[i].HasValue() ? state.sensors[i].filtered : snapshot.values[i];
+            }
+
+            _state.Publish(state);
+        }
+
+        void GetState(ConditioningState& state) const
+        {
+            _state.Read(state);
+        }
+
+        void WriteMetrics(Print& out)
+        {
+            ConditioningState state;
+            GetState(state);
+
+            out.println("# TYPE sensor_outliers_rejected_total counter");
+
+            for(uint8_t i = 0; i < SENSOR_COUNT; i++)
+                SimpleWeb::Printf(out, "sensor_outliers_rejected_total{device=\"%s\"} %u\n", Devices::Info(i).name, (unsigned int)state.sensors[i].rejected);
+        }
+    };
+}
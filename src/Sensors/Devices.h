@@ -0,0 +1,219 @@
+#pragma once
+#include <Arduino.h>
+#include <Ezo_i2c.h> //include the EZO I2C library from https://github.com/Atlas-Scientific/Ezo_I2c_lib
+
+/*
+    Every EZO board on the bus, declared once. Adding a board is one line in one of these lists.
+    X(name, I2C address, enable pin, level that turns the board on, kind)
+*/
+
+//boards read every cycle, their order is the order of SensorId
+#define SENSORS_PROBES(X) \
+    X(PH,   99,  12, LOW,  KindPh) \
+    X(ORP,  98,  27, LOW,  KindOrp) \
+    X(RTD,  102, 15, HIGH, KindRtd)
+
+//boards that are only sent commands
+#define SENSORS_OUTPUTS(X) \
+    X(PMPL, 109, 33, LOW,  KindPump)
+
+#define SENSORS_DEVICES(X) SENSORS_PROBES(X) SENSORS_OUTPUTS(X)
+
+namespace Sensors
+{
+    #define SENSORS_SENSOR_ID(name, address, pin, level, kind) SENSOR_##name,
+    #define SENSORS_DEVICE_ID(name, address, pin, level, kind) DEVICE_##name,
+
+    //position of each probe in the acquisition and snapshot arrays
+    enum SensorId
+    {
+        SENSORS_PROBES(SENSORS_SENSOR_ID)
+        SENSOR_COUNT
+    };
+
+    //position of each board in the registry, the probes come first so a SensorId is also a DeviceId
+    enum DeviceId
+    {
+        SENSORS_DEVICES(SENSORS_DEVICE_ID)
+        DEVICE_COUNT
+    };
+
+    #undef SENSORS_SENSOR_ID
+    #undef SENSORS_DEVICE_ID
+
+    #define SENSORS_NAME_SIZE(name, address, pin, level, kind) sizeof(#name) +
+
+    //characters in all the probe names with a terminator each, for sizing anything that holds every name
+    static const size_t PROBE_NAMES_SIZE = SENSORS_PROBES(SENSORS_NAME_SIZE) 0;
+
+    #undef SENSORS_NAME_SIZE
+
+    enum Capability
+    {
+        //answers R with a reading
+        CapabilityRead = 1,
+        //is sent the temperature with every read (RT,n)
+        CapabilityCompensated = 2,
+        //its reading is the temperature the others are compensated with
+        CapabilityTemperature = 4,
+        //dispenses a volume (D,n)
+        CapabilityDose = 8
+    };
+
+    enum DeviceKind
+    {
+        KindPh,
+        KindOrp,
+        KindRtd,
+        KindEc,
+        KindPump
+    };
+
+    struct HelpLine
+    {
+        const char* command;
+        const char* description;
+    };
+
+    /*
+        What every board of a kind has in common
+    */
+    struct KindInfo
+    {
+        //processing time of a read from the EZO datasheet, in milliseconds
+        unsigned long readTime;
+        //readings are kept as round(value * scale), see History
+        int32_t scale;
+        //decimal places that scale keeps
+        uint8_t decimals;
+        //change per minute that makes the Scheduler read it as often as it can
+        float activeRate;
+        //smallest jump from the median that Conditioning can throw out as an outlier
+        float spike;
+        uint8_t capabilities;
+        //listed by GET /HELP
+        const HelpLine* help;
+        uint8_t helpCount;
+
+        bool Has(Capability capability) const { return (capabilities & capability) != 0; }
+    };
+
+    struct DeviceInfo
+    {
+        const char* name;
+        uint8_t address;
+        uint8_t enablePin;
+        uint8_t enableLevel;
+        DeviceKind kind;
+    };
+
+    /*
+        Looks up the boards in the lists above.
+        Names are found with a switch on their FNV-1a hash, the compiler rejects two names that collide,
+        so a lookup is one hash and one strcmp with nothing allocated.
+    */
+    class Devices
+    {
+        private:
+        template<size_t Count>
+        static KindInfo MakeKind(unsigned long readTime, int32_t scale, uint8_t decimals, float activeRate, float spike, uint8_t capabilities, const HelpLine (&help)[Count])
+        {
+            KindInfo info = {readTime, scale, decimals, activeRate, spike, capabilities, help, Count};
+            return info;
+        }
+
+        public:
+        static constexpr uint32_t Hash(const char* name, uint32_t hash = 2166136261u)
+        {
+            return *name == '\0' ? hash : Hash(name + 1, (hash ^ (uint8_t)*name) * 16777619u);
+        }
+
+        static const DeviceInfo& Info(uint8_t device)
+        {
+            #define SENSORS_DEVICE_INFO(name, address, pin, level, kind) {#name, address, pin, level, kind},
+            static const DeviceInfo devices[DEVICE_COUNT] = { SENSORS_DEVICES(SENSORS_DEVICE_INFO) };
+            #undef SENSORS_DEVICE_INFO
+            return devices[device];
+        }
+
+        static const KindInfo& Kind(DeviceKind kind)
+        {
+            static const HelpLine phHelp[] = {
+                {"cal,mid,7", "calibrate to pH 7"},
+                {"cal,low,4", "calibrate to pH 4"},
+                {"cal,high,10", "calibrate to pH 10"},
+                {"cal,clear", "clear calibration"}};
+            static const HelpLine orpHelp[] = {
+                {"cal,225", "calibrate orp probe to 225mV"},
+                {"cal,clear", "clear calibration"}};
+            static const HelpLine rtdHelp[] = {
+                {"cal,t", "calibrate the temp probe to any temp value"},
+                {"cal,clear", "clear calibration"}};
+            static const HelpLine ecHelp[] = {
+                {"cal,dry", "calibrate with the probe dry"},
+                {"cal,low,n", "calibrate to the low point of n uS"},
+                {"cal,high,n", "calibrate to the high point of n uS"},
+                {"cal,clear", "clear calibration"}};
+            static const HelpLine pumpHelp[] = {
+                {"d,n", "dispense n ml"},
+                {"d,*", "dispense until stopped"},
+                {"x", "stop dispensing"},
+                {"tv,?", "total volume dispensed"}};
+
+            static const KindInfo kinds[] = {
+                MakeKind(900, 100, 2, 0.05, 0.2, CapabilityRead | CapabilityCompensated, phHelp),
+                MakeKind(900, 10, 1, 10, 25, CapabilityRead, orpHelp),
+                MakeKind(600, 100, 2, 0.2, 1, CapabilityRead | CapabilityTemperature, rtdHelp),
+                MakeKind(600, 1, 0, 50, 100, CapabilityRead | CapabilityCompensated, ecHelp),
+                MakeKind(300, 100, 2, 0, 0, CapabilityDose, pumpHelp)};
+
+            return kinds[kind];
+        }
+
+        static const KindInfo& KindOf(uint8_t device)
+        {
+            return Kind(Info(device).kind);
+        }
+
+        /*
+            The board object for a device, there is only ever one of each
+        */
+        static Ezo_board& Board(uint8_t device)
+        {
+            #define SENSORS_DEVICE_BOARD(name, address, pin, level, kind) Ezo_board(address, #name),
+            static Ezo_board boards[DEVICE_COUNT] = { SENSORS_DEVICES(SENSORS_DEVICE_BOARD) };
+            #undef SENSORS_DEVICE_BOARD
+            return boards[device];
+        }
+
+        /*
+            returns the DeviceId or -1 when there is no board by that name
+        */
+        static int Find(const char* name)
+        {
+            int device;
+
+            switch(Hash(name))
+            {
+                #define SENSORS_DEVICE_CASE(name, address, pin, level, kind) case Hash(#name): device = DEVICE_##name; break;
+                SENSORS_DEVICES(SENSORS_DEVICE_CASE)
+                #undef SENSORS_DEVICE_CASE
+                default: return -1;
+            }
+
+            return strcmp(name, Info(device).name) == 0 ? device : -1;
+        }
+
+        /*
+            Sets the enable pins so every board is on
+        */
+        static void Enable()
+        {
+            for(uint8_t i = 0; i < DEVICE_COUNT; i++)
+            {
+                pinMode(Info(i).enablePin, OUTPUT);
+                digitalWrite(Info(i).enablePin, Info(i).enableLevel);
+            }
+        }
+    };
+}
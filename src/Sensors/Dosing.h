@@ -0,0 +1,405 @@
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+#include "Devices.h"
+#include "CommandQueue.h"
+#include "ReadingSnapshot.h"
+#include "SeqLock.h"
+#include "../SimpleWeb/Metrics.h"
+
+//good reads in a row it takes to lift a lockout from a sensor error
+#ifndef SENSORS_DOSING_GOOD_READS
+#define SENSORS_DOSING_GOOD_READS 3
+#endif
+
+//where the daily count is kept so a reboot doesn't start the 24 hours over
+#ifndef SENSORS_DOSING_FILE
+#define SENSORS_DOSING_FILE "/dosing.bin"
+#endif
+
+namespace Sensors
+{
+    /*
+        What the dosing controller aims for and how careful it is, times in milliseconds and volumes in ml
+    */
+    struct DosingPolicy
+    {
+        bool enabled;
+        //probe whose filtered reading is controlled
+        uint8_t sensor;
+        //board that dispenses, it is sent D,<dose>
+        uint8_t pump;
+        //true doses while the reading is above target (acid for pH), false while it's below
+        bool above;
+        float target;
+        //how far past the target the reading has to drift before dosing starts, it stops at the target
+        float hysteresis;
+        float dose;
+        //time for a dose to mix in before the next one
+        uint32_t minInterval;
+        //no more than this is dispensed in 24 hours
+        float dailyLimit;
+        //bumped by the web task to lift a lockout
+        uint32_t resets;
+    };
+
+    enum DosingMode
+    {
+        DosingOff,
+        //reading is where it should be
+        DosingIdle,
+        //reading drifted past the hysteresis, dosing until it's back at the target
+        DosingActive,
+        //the daily limit has been dispensed
+        DosingLimited,
+        //something went wrong, no dosing until it clears or is reset
+        DosingLocked
+    };
+
+    struct DosingState
+    {
+        uint8_t mode;
+        //why it's locked
+        const char* reason;
+        float value;
+        //dispensed in the current 24 hours
+        float today;
+        float total;
+        uint32_t doses;
+        //millis() of the last dose, 0 when there hasn't been one
+        uint32_t lastDose;
+        //CommandQueue job of the last dose
+        uint32_t job;
+    };
+
+    /*
+        What of the DosingState survives a reboot, the ages are milliseconds before it was saved
+    */
+    struct DosingRecord
+    {
+        uint32_t dayAge;
+        uint32_t doseAge;
+        float today;
+        float total;
+        uint32_t doses;
+    };
+
+    /*
+        Bang-bang dosing with hysteresis, the Atlas kit's "dose PUMP_DOSE when EZO_BOARD is past COMPARISON_VALUE"
+        with the guards a pump full of acid needs:
+        - a dose only goes out minInterval after the last one so it has time to mix in before the next read counts
+        - no more than dailyLimit in 24 hours
+        - a failed read of the probe locks it out until the probe has read fine SENSORS_DOSING_GOOD_READS times in a row
+        - a dose the pump didn't take locks it out until it's reset from the web
+
+        Doses are queued as D,<ml> on the CommandQueue so the acquisition side sends them between reads and
+        nothing waits on the pump. Update() is only called from the acquisition side, the policy is set from
+        the web task and handed over through a SeqLock like the Scheduler's.
+
+        The daily count and the time of the last dose are saved to the file system after every dose, so a
+        reboot loop can't dose past the daily limit or sooner than minInterval. The time it was off isn't
+        known and doesn't count, a reboot can only make the 24 hours and the wait longer.
+    */
+    class Dosing
+    {
+        private:
+        SeqLock<DosingPolicy> _policy;
+        SeqLock<DosingState> _state;
+        CommandQueue& _commands;
+        //nothing is saved when it's nullptr
+        fs::FS* _fs;
+
+        //only touched by the web task
+        DosingPolicy _requested;
+
+        //only touched by the acquisition side
+        DosingPolicy _current;
+        DosingState _published;
+        uint32_t _resets;
+        uint8_t _goodReads;
+        //latched until Reset()
+        bool _pumpFailed;
+        bool _hasDosed;
+        unsigned long _dayStart;
+
+        void Lock(const char* reason)
+        {
+            if(_published.mode != DosingLocked)
+                Serial.printf("Dosing locked: %s\n", reason);
+
+            _published.mode = DosingLocked;
+
+            //a pump error is the one that has to be looked at
+            if(!_pumpFailed)
+                _published.reason = reason;
+        }
+
+        /*
+            Checks on the last dose.
+            returns false while it's still waiting to go out
+        */
+        bool CheckDose()
+        {
+            if(_published.job == 0)
+                return true;
+
+            JobResult result;
+
+            //replaced by newer jobs, it went out long ago
+            if(!_commands.Find(_published.job, result))
+            {
+                _published.job = 0;
+                return true;
+            }
+
+            if(result.status != JobDone)
+                return false;
+
+            if(result.error != Ezo_board::SUCCESS)
+            {
+                Lock("pump error");
+                _pumpFailed = true;
+            }
+
+            _published.job = 0;
+            return true;
+        }
+
+        void Save(unsigned long now)
+        {
+            if(_fs == nullptr)
+                return;
+
+            DosingRecord record = {(uint32_t)(now - _dayStart), (uint32_t)(now - _published.lastDose), _published.today, _published.total, _published.doses};
+            File file = _fs->open(SENSORS_DOSING_FILE, "w");
+
+            if(!file || file.write((const uint8_t*)&record, sizeof(record)) != sizeof(record))
+                Serial.println("Can't save the dosing count");
+
+            file.close();
+        }
+
+        /*
+            How far past the target the reading is in the direction that needs dosing
+        */
+        float Excess(float value) const
+        {
+            return _current.above ? value - _current.target : _current.target - value;
+        }
+
+        void Dose(unsigned long now)
+        {
+            char command[Job::COMMAND_SIZE];
+            snprintf(command, sizeof(command), "D,%.1f", _current.dose);
+            uint32_t job = _commands.Submit(_current.pump, command);
+
+            //queue is full, try again next read
+            if(job == 0)
+                return;
+
+            Serial.printf("Dosing %s\n", command);
+            _published.job = job;
+            _published.lastDose = now;
+            _published.doses++;
+            //counted when it's sent so a dose that fails still counts against the limit
+            _published.today += _current.dose;
+            _published.total += _current.dose;
+            _hasDosed = true;
+            Save(now);
+        }
+
+        public:
+        Dosing(CommandQueue& commands) : _commands(commands), _fs(nullptr), _resets(0), _goodReads(0), _pumpFailed(false), _hasDosed(false), _dayStart(0)
+        {
+            memset(&_requested, 0, sizeof(_requested));
+            memset(&_published, 0, sizeof(_published));
+            _published.reason = "";
+            _current = _requested;
+            _published.mode = DosingOff;
+            _policy.Publish(_requested);
+            _state.Publish(_published);
+        }
+
+        /*
+            Picks up the count from before a reboot and saves it from now on, call from setup() once the
+            file system is mounted and before the first Update()
+        */
+        void Begin(fs::FS& fs, unsigned long now)
+        {
+            DosingRecord record;
+            _fs = &fs;
+
+            if(!_fs->exists(SENSORS_DOSING_FILE))
+                return;
+
+            File file = _fs->open(SENSORS_DOSING_FILE, "r");
+            bool loaded = file && file.read((uint8_t*)&record, sizeof(record)) == sizeof(record);
+            file.close();
+
+            //cut short while it was written, start over
+            if(!loaded)
+                return;
+
+            _dayStart = now - record.dayAge;
+            _published.today = record.today;
+            _published.total = record.total;
+            _published.doses = record.doses;
+            _published.lastDose = now - record.doseAge;
+            _hasDosed = record.doses > 0;
+            _state.Publish(_published);
+            Serial.printf("Dosing has %.1f ml today from before the reboot\n", record.today);
+        }
+
+        /*
+            Runs the controller on a completed cycle, sensors is the bit mask of the probes that were read
+        */
+        void Update(unsigned long now, uint8_t sensors, const ReadingSnapshot& snapshot)
+        {
+            _policy.TryRead(_current);
+
+            if(now - _dayStart >= 24UL * 60 * 60 * 1000)
+            {
+                _dayStart = now;
+                _published.today = 0;
+                Save(now);
+            }
+
+            bool sent = CheckDose();
+
+            if(_current.resets != _resets && _published.mode == DosingLocked)
+            {
+                Serial.println("Dosing reset");
+                _published.mode = DosingIdle;
+                _published.reason = "";
+                _pumpFailed = false;
+                _goodReads = SENSORS_DOSING_GOOD_READS;
+            }
+
+            _resets = _current.resets;
+
+            if(!_current.enabled)
+            {
+                if(_published.mode != DosingLocked)
+                    _published.mode = DosingOff;
+
+                _state.Publish(_published);
+                return;
+            }
+
+            if((sensors & (1 << _current.sensor)) != 0)
+            {
+                if(snapshot.errors[_current.sensor] != Ezo_board::SUCCESS)
+                {
+                    _goodReads = 0;
+                    Lock("sensor error");
+                }
+                else if(_goodReads < SENSORS_DOSING_GOOD_READS)
+                {
+                    _goodReads++;
+
+                    if(_goodReads == SENSORS_DOSING_GOOD_READS && _published.mode == DosingLocked && !_pumpFailed)
+                    {
+                        Serial.println("Dosing unlocked");
+                        _published.mode = DosingIdle;
+                        _published.reason = "";
+                    }
+                }
+
+                _published.value = snapshot.filtered[_current.sensor];
+            }
+
+            if(_published.mode == DosingLocked || _goodReads < SENSORS_DOSING_GOOD_READS)
+            {
+                if(_published.mode == DosingOff)
+                    _published.mode = DosingIdle;
+
+                _state.Publish(_published);
+                return;
+            }
+
+            float excess = Excess(_published.value);
+
+            if(excess <= 0)
+                _published.mode = DosingIdle;
+            else if(excess > _current.hysteresis || _published.mode == DosingActive || _published.mode == DosingLimited)
+                _published.mode = DosingActive;
+            else if(_published.mode == DosingOff)
+                _published.mode = DosingIdle;
+
+            if(_published.mode == DosingActive && _published.today + _current.dose > _current.dailyLimit)
+                _published.mode = DosingLimited;
+
+            if(_published.mode == DosingActive && sent && (!_hasDosed || now - _published.lastDose >= _current.minInterval))
+                Dose(now);
+
+            _state.Publish(_published);
+        }
+
+        /*
+            Changes the policy. Only call from the web task.
+            returns false when it doesn't make sense
+        */
+        bool SetPolicy(const DosingPolicy& policy)
+        {
+            if(policy.sensor >= SENSOR_COUNT || policy.pump >= DEVICE_COUNT || !Devices::KindOf(policy.pump).Has(CapabilityDose))
+                return false;
+
+            if(!(policy.dose > 0) || !(policy.hysteresis >= 0) || !(policy.dailyLimit >= policy.dose))
+                return false;
+
+            //only Reset() lifts a lockout
+            uint32_t resets = _requested.resets;
+            _requested = policy;
+            _requested.resets = resets;
+            _policy.Publish(_requested);
+            return true;
+        }
+
+        /*
+            Lifts a lockout on the next read. Only call from the web task.
+        */
+        void Reset()
+        {
+            _requested.resets++;
+            _policy.Publish(_requested);
+        }
+
+        /*
+            The policy as last set. Only call from the web task.
+        */
+        const DosingPolicy& GetPolicy() const
+        {
+            return _requested;
+        }
+
+        void GetState(DosingState& state) const
+        {
+            _state.Read(state);
+        }
+
+        static const char* ModeName(uint8_t mode)
+        {
+            switch(mode)
+            {
+                case DosingIdle: return "idle";
+                case DosingActive: return "dosing";
+                case DosingLimited: return "limited";
+                case DosingLocked: return "locked";
+                default: return "off";
+            }
+        }
+
+        void WriteMetrics(Print& out)
+        {
+            DosingState state;
+            GetState(state);
+
+            out.println("# TYPE dosing_doses_total counter");
+            SimpleWeb::Printf(out, "dosing_doses_total %u\n", (unsigned int)state.doses);
+            out.println("# TYPE dosing_volume_milliliters_total counter");
+            SimpleWeb::Printf(out, "dosing_volume_milliliters_total %.1f\n", state.total);
+            out.println("# TYPE dosing_locked gauge");
+            SimpleWeb::Printf(out, "dosing_locked %u\n", state.mode == DosingLocked ? 1 : 0);
+        }
+    };
+}
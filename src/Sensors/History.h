@@ -0,0 +1,443 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <Ezo_i2c.h> //include the EZO I2C library from https://github.com/Atlas-Scientific/Ezo_I2c_lib
+#include "Devices.h"
+#include "ReadingSnapshot.h"
+#include "../SimpleWeb/Metrics.h"
+
+//size of one block of the history ring in bytes, the oldest block is dropped when the ring is full
+#ifndef SENSORS_HISTORY_BLOCK_SIZE
+#define SENSORS_HISTORY_BLOCK_SIZE 1024
+#endif
+
+//how many blocks are in the ring, 48 x 1KB holds a few days of 10 second cycles
+#ifndef SENSORS_HISTORY_BLOCKS
+#define SENSORS_HISTORY_BLOCKS 48
+#endif
+
+namespace Sensors
+{
+    /*
+        One decoded cycle, values are NAN when the read failed
+    */
+    struct HistorySample
+    {
+        //seconds since boot
+        uint32_t time;
+        float values[SENSOR_COUNT];
+    };
+
+    /*
+        Reads a bit stream written least significant bit first
+    */
+    class BitReader
+    {
+        private:
+        const uint32_t* _words;
+        uint32_t _length;
+        uint32_t _position;
+
+        public:
+        BitReader(const uint32_t* words, uint32_t length) : _words(words), _length(length), _position(0)
+        {
+        }
+
+        bool AtEnd() const { return _position >= _length; }
+
+        uint32_t Read(uint8_t count)
+        {
+            uint32_t word = _position >> 5;
+            uint8_t offset = _position & 31;
+            uint64_t bits = _words[word] >> offset;
+
+            if(offset + count > 32)
+                bits |= (uint64_t)_words[word + 1] << (32 - offset);
+
+            _position += count;
+            return count == 32 ? (uint32_t)bits : (uint32_t)bits & ((1u << count) - 1);
+        }
+    };
+
+    /*
+        Fixed memory history of every acquisition cycle.
+
+        Samples are packed into a ring of blocks. The first sample of a block is stored in full so a block
+        can be decoded on its own and the oldest one dropped, after that:
+            - the time is stored as the change in the interval (delta of delta), which is 0 most of the time
+            - a 0 bit when every probe was read in the cycle, otherwise a 1 and the bit mask of the ones that were
+            - each value that was read is quantized (0.01 pH, 0.1 mV, 0.01 C, see Devices) and stored as the change from the last one
+        Both use the same variable length code, so a cycle where nothing moved takes 5 bits.
+        A probe that wasn't read in a cycle comes back as NAN for it, like a failed read.
+
+        Append() is only called by the acquisition side, any other task can read. Each block has a
+        sequence number like SeqLock, a reader copies the block and drops it if it was recycled during the copy.
+    */
+    class History
+    {
+        private:
+        /*
+            Quantization of each sensor from the device registry, the value is stored as round(value * scale)
+        */
+        static int32_t Scale(uint8_t sensor)
+        {
+            return Devices::KindOf(sensor).scale;
+        }
+
+        static const uint32_t BLOCK_WORDS = SENSORS_HISTORY_BLOCK_SIZE / sizeof(uint32_t);
+        static const uint32_t BLOCK_BITS = BLOCK_WORDS * 32;
+        //widest sample, a prefix and 32 bits for the time and every value and the sampled mask
+        static const uint32_t MAX_SAMPLE_BITS = (SENSOR_COUNT + 1) * (4 + 32) + 1 + SENSOR_COUNT;
+        //stored for a failed read
+        static const int32_t MISSING = INT32_MIN;
+
+        enum Field
+        {
+            FieldTime,
+            FieldValue
+        };
+
+        /*
+            Widths of the three short codes for a field.
+            The interval mostly changes by a second or two, values by a few hundredths.
+        */
+        static uint8_t Width(Field field, uint8_t code)
+        {
+            static const uint8_t widths[2][3] = {{4, 12, 20}, {5, 9, 16}};
+            return widths[field][code];
+        }
+
+        struct Block
+        {
+            //odd while the block is being recycled, 0 when it has never been used
+            std::atomic<uint32_t> sequence;
+            //bits of complete samples, released after the bits are written
+            std::atomic<uint32_t> length;
+            std::atomic<uint32_t> firstTime;
+            std::atomic<uint32_t> lastTime;
+            std::atomic<uint32_t> words[BLOCK_WORDS];
+        };
+
+        Block _blocks[SENSORS_HISTORY_BLOCKS];
+        //block being appended to
+        std::atomic<uint32_t> _head;
+        std::atomic<uint32_t> _samples;
+
+        //only touched by the writer
+        uint32_t _length;
+        uint32_t _lastTime;
+        int32_t _lastInterval;
+        int32_t _lastValues[SENSOR_COUNT];
+
+        void Write(uint32_t value, uint8_t count)
+        {
+            Block& block = _blocks[_head.load(std::memory_order_relaxed)];
+            uint32_t word = _length >> 5;
+            uint8_t offset = _length & 31;
+
+            if(count < 32)
+                value &= (1u << count) - 1;
+
+            block.words[word].store(block.words[word].load(std::memory_order_relaxed) | (value << offset), std::memory_order_relaxed);
+
+            if(offset + count > 32)
+                block.words[word + 1].store(value >> (32 - offset), std::memory_order_relaxed);
+
+            _length += count;
+        }
+
+        static bool Fits(int64_t value, uint8_t bits)
+        {
+            return value >= -(1 << (bits - 1)) && value < (1 << (bits - 1));
+        }
+
+        /*
+            0 is a single 0 bit, then 10, 110 and 1110 in front of a number of the given widths
+            and 1111 in front of a full 32 bits.
+            A value read back from 1111 is taken as it is, not as a difference, so a value that doesn't fit
+            the short codes has to be written with full set. The time adds it either way.
+        */
+        void WriteNumber(int32_t value, Field field, bool full)
+        {
+            if(!full)
+            {
+                if(value == 0)
+                {
+                    Write(0, 1);
+                    return;
+                }
+
+                for(uint8_t i = 0; i < 3; i++)
+                {
+                    if(Fits(value, Width(field, i)))
+                    {
+                        //i + 1 ones then a zero
+                        Write((1u << (i + 1)) - 1, i + 2);
+                        Write((uint32_t)value, Width(field, i));
+                        return;
+                    }
+                }
+            }
+
+            Write(0xF, 4);
+            Write((uint32_t)value, 32);
+        }
+
+        /*
+            returns the number and sets full when it was stored with all 32 bits
+        */
+        static int32_t ReadNumber(BitReader& reader, Field field, bool& full)
+        {
+            full = false;
+            uint8_t ones = 0;
+
+            while(ones < 4 && reader.Read(1) == 1)
+                ones++;
+
+            if(ones == 0)
+                return 0;
+
+            if(ones == 4)
+            {
+                full = true;
+                return (int32_t)reader.Read(32);
+            }
+
+            uint8_t width = Width(field, ones - 1);
+            uint32_t bits = reader.Read(width);
+
+            //sign extend
+            if(bits & (1u << (width - 1)))
+                bits |= ~((1u << width) - 1);
+
+            return (int32_t)bits;
+        }
+
+        /*
+            Recycles the next block and stores the sample in full at the start of it
+        */
+        void StartBlock(uint32_t time, uint8_t sampled, const int32_t (&values)[SENSOR_COUNT])
+        {
+            uint32_t head = _samples.load(std::memory_order_relaxed) == 0 ? 0 : (_head.load(std::memory_order_relaxed) + 1) % SENSORS_HISTORY_BLOCKS;
+            Block& block = _blocks[head];
+            uint32_t sequence = block.sequence.load(std::memory_order_relaxed);
+
+            block.sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            for(uint32_t i = 0; i < BLOCK_WORDS; i++)
+                block.words[i].store(0, std::memory_order_relaxed);
+
+            block.length.store(0, std::memory_order_relaxed);
+            block.firstTime.store(time, std::memory_order_relaxed);
+            block.lastTime.store(time, std::memory_order_relaxed);
+            _head.store(head, std::memory_order_relaxed);
+            _length = 0;
+
+            Write(time, 32);
+            Write(sampled, SENSOR_COUNT);
+
+            //the ones that weren't read too, they are what the next read is a change from
+            for(uint8_t i = 0; i < SENSOR_COUNT; i++)
+                Write((uint32_t)values[i], 32);
+
+            block.length.store(_length, std::memory_order_release);
+            block.sequence.store(sequence + 2, std::memory_order_release);
+            _head.store(head, std::memory_order_release);
+        }
+
+        /*
+            Copies a block out for decoding.
+            returns false when it has never been used or was recycled during the copy
+        */
+        bool CopyBlock(uint32_t index, uint32_t (&words)[BLOCK_WORDS], uint32_t& length, uint32_t& firstTime, uint32_t& lastTime) const
+        {
+            const Block& block = _blocks[index];
+            uint32_t before = block.sequence.load(std::memory_order_acquire);
+
+            if(before == 0 || (before & 1))
+                return false;
+
+            length = block.length.load(std::memory_order_acquire);
+            firstTime = block.firstTime.load(std::memory_order_relaxed);
+            lastTime = block.lastTime.load(std::memory_order_relaxed);
+
+            for(uint32_t i = 0; i < (length + 31) / 32; i++)
+                words[i] = block.words[i].load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return block.sequence.load(std::memory_order_relaxed) == before;
+        }
+
+        public:
+        History() : _head(0), _samples(0), _length(0), _lastTime(0), _lastInterval(0)
+        {
+            for(uint32_t i = 0; i < SENSORS_HISTORY_BLOCKS; i++)
+            {
+                _blocks[i].sequence.store(0, std::memory_order_relaxed);
+                _blocks[i].length.store(0, std::memory_order_relaxed);
+                _blocks[i].firstTime.store(0, std::memory_order_relaxed);
+                _blocks[i].lastTime.store(0, std::memory_order_relaxed);
+            }
+
+            for(uint8_t i = 0; i < SENSOR_COUNT; i++)
+                _lastValues[i] = MISSING;
+        }
+
+        /*
+            Adds a complete cycle, only the probes in snapshot.sampled are stored. Only call from the acquisition side.
+            time is in seconds and can't go backwards
+        */
+        void Append(uint32_t time, const ReadingSnapshot& snapshot)
+        {
+            int32_t values[SENSOR_COUNT];
+            uint8_t sampled = snapshot.sampled & ALL_SENSORS;
+
+            for(uint8_t i = 0; i < SENSOR_COUNT; i++)
+            {
+                float value = snapshot.values[i];
+
+                if((sampled & (1 << i)) == 0)
+                    values[i] = _lastValues[i];
+                else if(snapshot.errors[i] != Ezo_board::SUCCESS || isnan(value) || fabsf(value * Scale(i)) >= 2147483520.0f)
+                    values[i] = MISSING;
+                else
+                    values[i] = (int32_t)lroundf(value * Scale(i));
+            }
+
+            if(_samples.load(std::memory_order_relaxed) == 0 || _length + MAX_SAMPLE_BITS > BLOCK_BITS)
+            {
+                StartBlock(time, sampled, values);
+                _lastInterval = 0;
+            }
+            else
+            {
+                int32_t interval = (int32_t)(time - _lastTime);
+                WriteNumber(interval - _lastInterval, FieldTime, false);
+                _lastInterval = interval;
+
+                if(sampled == ALL_SENSORS)
+                {
+                    Write(0, 1);
+                }
+                else
+                {
+                    Write(1, 1);
+                    Write(sampled, SENSOR_COUNT);
+                }
+
+                for(uint8_t i = 0; i < SENSOR_COUNT; i++)
+                {
+                    if((sampled & (1 << i)) == 0)
+                        continue;
+
+                    //a failed read on either side can't be a difference, and a jump too big for the short codes
+                    //(ex: the RTD reading -1023 when it's unplugged) is stored as the value
+                    int64_t delta = (int64_t)values[i] - _lastValues[i];
+                    bool full = (values[i] == MISSING) != (_lastValues[i] == MISSING) || !Fits(delta, Width(FieldValue, 2));
+                    WriteNumber(full ? values[i] : (int32_t)delta, FieldValue, full);
+                }
+
+                Block& block = _blocks[_head.load(std::memory_order_relaxed)];
+                block.lastTime.store(time, std::memory_order_relaxed);
+                block.length.store(_length, std::memory_order_release);
+            }
+
+            _lastTime = time;
+            memcpy(_lastValues, values, sizeof(values));
+            _samples.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /*
+            Calls visit(const HistorySample&) for every sample from..to (inclusive) oldest first.
+            Decodes one block at a time into a copy on the stack, so the writer is never held up.
+            returns the number of samples visited
+        */
+        template<typename Visitor>
+        uint32_t Read(uint32_t from, uint32_t to, Visitor visit) const
+        {
+            uint32_t words[BLOCK_WORDS];
+            uint32_t head = _head.load(std::memory_order_acquire);
+            uint32_t visited = 0;
+            //a block recycled after this starts comes around again as the oldest with newer samples, it's skipped
+            uint32_t headFirstTime = _blocks[head].firstTime.load(std::memory_order_relaxed);
+
+            for(uint32_t i = 1; i <= SENSORS_HISTORY_BLOCKS; i++)
+            {
+                uint32_t length, firstTime, lastTime;
+
+                if(!CopyBlock((head + i) % SENSORS_HISTORY_BLOCKS, words, length, firstTime, lastTime))
+                    continue;
+
+                if(lastTime < from || firstTime > to)
+                    continue;
+
+                if(i < SENSORS_HISTORY_BLOCKS && firstTime > headFirstTime)
+                    continue;
+
+                BitReader reader(words, length);
+                HistorySample sample;
+                int32_t values[SENSOR_COUNT];
+                int32_t interval = 0;
+                bool full;
+
+                sample.time = reader.Read(32);
+                uint8_t sampled = reader.Read(SENSOR_COUNT);
+
+                for(uint8_t s = 0; s < SENSOR_COUNT; s++)
+                    values[s] = (int32_t)reader.Read(32);
+
+                while(true)
+                {
+                    if(sample.time >= from && sample.time <= to)
+                    {
+                        for(uint8_t s = 0; s < SENSOR_COUNT; s++)
+                            sample.values[s] = (sampled & (1 << s)) == 0 || values[s] == MISSING ? NAN : (float)values[s] / Scale(s);
+
+                        visit(sample);
+                        visited++;
+                    }
+
+                    if(reader.AtEnd())
+                        break;
+
+                    interval += ReadNumber(reader, FieldTime, full);
+                    sample.time += interval;
+                    sampled = reader.Read(1) == 0 ? ALL_SENSORS : reader.Read(SENSOR_COUNT);
+
+                    for(uint8_t s = 0; s < SENSOR_COUNT; s++)
+                    {
+                        if((sampled & (1 << s)) == 0)
+                            continue;
+
+                        int32_t value = ReadNumber(reader, FieldValue, full);
+                        values[s] = full ? value : values[s] + value;
+                    }
+                }
+            }
+
+            return visited;
+        }
+
+        /*
+            Writes how much has been stored in the Prometheus text format
+        */
+        void WriteMetrics(Print& out) const
+        {
+            uint32_t bits = 0;
+
+            for(uint32_t i = 0; i < SENSORS_HISTORY_BLOCKS; i++)
+                bits += _blocks[i].length.load(std::memory_order_relaxed);
+
+            out.println("# TYPE history_samples_total counter");
+            SimpleWeb::Printf(out, "history_samples_total %u\n", (unsigned int)_samples.load(std::memory_order_relaxed));
+            out.println("# TYPE history_used_bytes gauge");
+            SimpleWeb::Printf(out, "history_used_bytes %u\n", (unsigned int)(bits / 8));
+            out.println("# TYPE history_capacity_bytes gauge");
+            SimpleWeb::Printf(out, "history_capacity_bytes %u\n", (unsigned int)sizeof(_blocks));
+        }
+    };
+}
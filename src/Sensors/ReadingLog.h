@@ -0,0 +1,518 @@
+#pragma once
+#include <Arduino.h>
+#include <FS.h>
+#include <stddef.h>
+#include "ReadingSnapshot.h"
+#include "History.h"
+#include "../SimpleWeb/Metrics.h"
+
+//where the segments go on the file system
+#ifndef SENSORS_LOG_DIRECTORY
+#define SENSORS_LOG_DIRECTORY "/log"
+#endif
+
+//records per segment file, 1024 x 24 bytes (3 probes) is a little under 3 hours of 10 second cycles
+#ifndef SENSORS_LOG_SEGMENT_RECORDS
+#define SENSORS_LOG_SEGMENT_RECORDS 1024
+#endif
+
+//most segments kept before the oldest is deleted, Begin() lowers it to what fits the partition,
+//44 on the 1.4MB of the default partition table which is a little over 5 days
+#ifndef SENSORS_LOG_SEGMENTS
+#define SENSORS_LOG_SEGMENTS 64
+#endif
+
+//records held in RAM and written together, fewer writes means less flash wear
+#ifndef SENSORS_LOG_BATCH
+#define SENSORS_LOG_BATCH 16
+#endif
+
+namespace Sensors
+{
+    /*
+        One cycle as it is stored in flash
+    */
+    struct LogRecord
+    {
+        uint32_t time;
+        float values[SENSOR_COUNT];
+        //Ezo_board::errors
+        uint8_t errors[SENSOR_COUNT];
+        //bit mask of SensorId that weren't read in the cycle, with 3 probes it's what was the padding so older records read as all sampled
+        uint8_t skipped;
+        //FNV-1a of everything above, a record cut short by a power loss won't match
+        uint32_t checksum;
+    };
+
+    static_assert(sizeof(LogRecord) % sizeof(uint32_t) == 0, "log records are packed back to back on flash");
+
+    /*
+        Time range of one segment file, the index has one of these per file
+    */
+    struct LogSegment
+    {
+        uint32_t id;
+        uint32_t firstTime;
+        uint32_t lastTime;
+        //complete records, anything after them is ignored
+        uint32_t records;
+    };
+
+    /*
+        Append only log of every cycle on flash (LittleFS or SPIFFS), so the readings survive a reboot.
+
+        Records go into numbered segment files of SENSORS_LOG_SEGMENT_RECORDS each, when there are
+        too many segments the oldest file is deleted. How many is too many comes from the size of the
+        partition, and when a write fails anyway the oldest is deleted to make room and the limit drops by one. Records are batched in RAM and written
+        SENSORS_LOG_BATCH at a time.
+
+        The time range of every segment is kept in RAM, so a read only opens the segments that overlap
+        and then binary searches for the first record in the range.
+
+        When the last segment ends in a record that was cut short by a power loss, the complete records
+        are kept and appending carries on in a new segment.
+
+        Append() and Flush() are only called by the acquisition side, Read() can be called from any task.
+    */
+    class ReadingLog
+    {
+        private:
+        fs::FS* _fs;
+        LogSegment _segments[SENSORS_LOG_SEGMENTS];
+        uint8_t _segmentCount;
+        //segments kept, at most SENSORS_LOG_SEGMENTS
+        uint8_t _segmentLimit;
+        //guards the index, the reader copies it and lets go
+        portMUX_TYPE _lock = portMUX_INITIALIZER_UNLOCKED;
+        LogRecord _batch[SENSORS_LOG_BATCH];
+        uint8_t _batchCount;
+        //the last segment can't be appended to
+        bool _sealed;
+        uint32_t _lastTime;
+
+        SimpleWeb::Counter _bytesWritten;
+        SimpleWeb::Counter _writeErrors;
+        SimpleWeb::Counter _tornRecords;
+
+        static uint32_t Checksum(const LogRecord& record)
+        {
+            const uint8_t* bytes = (const uint8_t*)&record;
+            uint32_t hash = 2166136261u;
+
+            for(size_t i = 0; i < offsetof(LogRecord, checksum); i++)
+                hash = (hash ^ bytes[i]) * 16777619u;
+
+            return hash;
+        }
+
+        static bool IsValid(const LogRecord& record)
+        {
+            return record.checksum == Checksum(record);
+        }
+
+        static void SegmentPath(uint32_t id, char (&path)[32])
+        {
+            snprintf(path, sizeof(path), SENSORS_LOG_DIRECTORY "/%08u.bin", (unsigned int)id);
+        }
+
+        static bool ReadRecord(File& file, uint32_t index, LogRecord& record)
+        {
+            return file.seek(index * sizeof(LogRecord)) &&
+                file.read((uint8_t*)&record, sizeof(LogRecord)) == sizeof(LogRecord) &&
+                IsValid(record);
+        }
+
+        /*
+            Finds the time range of a segment, dropping a torn tail.
+            returns false when the segment has no complete records
+        */
+        bool LoadSegment(LogSegment& segment)
+        {
+            char path[32];
+            LogRecord record;
+            SegmentPath(segment.id, path);
+            File file = _fs->open(path, "r");
+
+            if(!file)
+                return false;
+
+            segment.records = file.size() / sizeof(LogRecord);
+
+            if(file.size() % sizeof(LogRecord) != 0)
+                _tornRecords.Increment();
+
+            //only the tail can be torn, so walk back from the end to the last complete record
+            while(segment.records > 0 && !ReadRecord(file, segment.records - 1, record))
+            {
+                _tornRecords.Increment();
+                segment.records--;
+            }
+
+            if(segment.records == 0)
+            {
+                file.close();
+                return false;
+            }
+
+            if(segment.records * sizeof(LogRecord) != file.size())
+                _sealed = true;
+
+            segment.lastTime = record.time;
+            ReadRecord(file, 0, record);
+            segment.firstTime = record.time;
+            file.close();
+            return true;
+        }
+
+        void RemoveOldest()
+        {
+            char path[32];
+            SegmentPath(_segments[0].id, path);
+            _fs->remove(path);
+
+            portENTER_CRITICAL(&_lock);
+            memmove(_segments, _segments + 1, (_segmentCount - 1) * sizeof(LogSegment));
+            _segmentCount--;
+            portEXIT_CRITICAL(&_lock);
+        }
+
+        void NewSegment()
+        {
+            uint32_t id = _segmentCount == 0 ? 1 : _segments[_segmentCount - 1].id + 1;
+
+            while(_segmentCount >= _segmentLimit)
+                RemoveOldest();
+
+            LogSegment segment = {id, 0, 0, 0};
+
+            portENTER_CRITICAL(&_lock);
+            _segments[_segmentCount++] = segment;
+            portEXIT_CRITICAL(&_lock);
+
+            _sealed = false;
+        }
+
+        /*
+            First record at or after the time, the records in a segment are in time order
+        */
+        static uint32_t FindFirst(File& file, const LogSegment& segment, uint32_t from)
+        {
+            uint32_t low = 0;
+            uint32_t high = segment.records;
+            LogRecord record;
+
+            while(low < high)
+            {
+                uint32_t middle = low + (high - low) / 2;
+
+                if(ReadRecord(file, middle, record) && record.time < from)
+                    low = middle + 1;
+                else
+                    high = middle;
+            }
+
+            return low;
+        }
+
+        public:
+        ReadingLog() :
+            _fs(nullptr),
+            _segmentCount(0),
+            _segmentLimit(SENSORS_LOG_SEGMENTS),
+            _batchCount(0),
+            _sealed(false),
+            _lastTime(0)
+        {
+        }
+
+        /*
+            Builds the index from the segments already on the file system, call once it's mounted.
+            capacity is the size of the partition in bytes (LittleFS.totalBytes()), the segments get 3/4 of it
+            and LittleFS the rest for its metadata and copy on write.
+            returns false when the log directory can't be used, nothing is logged then
+        */
+        bool Begin(fs::FS& fs, size_t capacity)
+        {
+            size_t segments = capacity * 3 / 4 / (SENSORS_LOG_SEGMENT_RECORDS * sizeof(LogRecord));
+            _segmentLimit = segments < 2 ? 2 : segments > SENSORS_LOG_SEGMENTS ? SENSORS_LOG_SEGMENTS : segments;
+            _fs = &fs;
+
+            if(!_fs->exists(SENSORS_LOG_DIRECTORY))
+                _fs->mkdir(SENSORS_LOG_DIRECTORY);
+
+            File directory = _fs->open(SENSORS_LOG_DIRECTORY);
+
+            if(!directory || !directory.isDirectory())
+            {
+                Serial.println("Can't open the reading log directory");
+                _fs = nullptr;
+                return false;
+            }
+
+            //segment ids in order, only the newest are kept
+            uint32_t ids[SENSORS_LOG_SEGMENTS];
+            uint8_t count = 0;
+
+            for(File file = directory.openNextFile(); file; file = directory.openNextFile())
+            {
+                //name() is the full path on older cores
+                const char* name = strrchr(file.name(), '/');
+                uint32_t id = strtoul(name == nullptr ? file.name() : name + 1, nullptr, 10);
+                file.close();
+
+                if(id == 0)
+                    continue;
+
+                char path[32];
+
+                if(count == _segmentLimit)
+                {
+                    if(id < ids[0])
+                    {
+                        SegmentPath(id, path);
+                        _fs->remove(path);
+                        continue;
+                    }
+
+                    SegmentPath(ids[0], path);
+                    _fs->remove(path);
+                    memmove(ids, ids + 1, (--count) * sizeof(uint32_t));
+                }
+
+                uint8_t i = count++;
+
+                for(; i > 0 && ids[i - 1] > id; i--)
+                    ids[i] = ids[i - 1];
+
+                ids[i] = id;
+            }
+
+            directory.close();
+
+            for(uint8_t i = 0; i < count; i++)
+            {
+                LogSegment& segment = _segments[_segmentCount];
+                segment.id = ids[i];
+
+                //a segment with nothing readable in it is just deleted
+                if(LoadSegment(segment))
+                {
+                    _segmentCount++;
+                    _lastTime = segment.lastTime;
+                }
+                else
+                {
+                    char path[32];
+                    SegmentPath(ids[i], path);
+                    _fs->remove(path);
+                }
+            }
+
+            Serial.printf("Reading log has %u of %u segments, last time %u\n", _segmentCount, _segmentLimit, (unsigned int)_lastTime);
+            return true;
+        }
+
+        /*
+            Time of the last record that made it to flash, 0 when there isn't one
+        */
+        uint32_t LastTime() const { return _lastTime; }
+
+        /*
+            Adds a cycle, it goes to flash with the rest of the batch. Only call from the acquisition side.
+            time can't go backwards
+        */
+        void Append(uint32_t time, const ReadingSnapshot& snapshot)
+        {
+            if(_fs == nullptr)
+                return;
+
+            LogRecord& record = _batch[_batchCount++];
+            //the padding is part of the checksum
+            memset(&record, 0, sizeof(record));
+            record.time = time;
+            record.skipped = ~snapshot.sampled & ALL_SENSORS;
+
+            for(uint8_t i = 0; i < SENSOR_COUNT; i++)
+            {
+                record.values[i] = snapshot.values[i];
+                record.errors[i] = snapshot.errors[i];
+            }
+
+            record.checksum = Checksum(record);
+
+            if(_batchCount == SENSORS_LOG_BATCH)
+                Flush();
+        }
+
+        /*
+            Writes the batch to the end of the last segment. Only call from the acquisition side.
+        */
+        void Flush()
+        {
+            uint8_t written = 0;
+            bool retried = false;
+
+            while(_fs != nullptr && written < _batchCount)
+            {
+                if(_segmentCount == 0 || _sealed || _segments[_segmentCount - 1].records == SENSORS_LOG_SEGMENT_RECORDS)
+                    NewSegment();
+
+                LogSegment& segment = _segments[_segmentCount - 1];
+                uint32_t space = SENSORS_LOG_SEGMENT_RECORDS - segment.records;
+                uint32_t count = (uint32_t)(_batchCount - written) < space ? _batchCount - written : space;
+                char path[32];
+                SegmentPath(segment.id, path);
+
+                File file = _fs->open(path, "a");
+                size_t bytes = file ? file.write((const uint8_t*)(_batch + written), count * sizeof(LogRecord)) : 0;
+                file.close();
+                _bytesWritten.Increment(bytes);
+                bool failed = bytes != count * sizeof(LogRecord);
+
+                if(failed)
+                {
+                    //the end of the file can't be trusted anymore, what did make it is found by Begin() after a reboot
+                    Serial.printf("Reading log write failed %u of %u bytes\n", (unsigned int)bytes, (unsigned int)(count * sizeof(LogRecord)));
+                    _writeErrors.Increment();
+                    _sealed = true;
+                    count = bytes / sizeof(LogRecord);
+                }
+
+                if(count > 0)
+                {
+                    portENTER_CRITICAL(&_lock);
+
+                    if(segment.records == 0)
+                        segment.firstTime = _batch[written].time;
+
+                    segment.records += count;
+                    segment.lastTime = _batch[written + count - 1].time;
+                    portEXIT_CRITICAL(&_lock);
+
+                    _lastTime = segment.lastTime;
+                }
+
+                written += count;
+
+                //most likely the partition is full, keep one segment less from now on and try again once
+                //in the space the oldest frees up
+                if(failed && !retried && _segmentCount > 2)
+                {
+                    retried = true;
+                    _segmentLimit = _segmentCount - 1;
+                    RemoveOldest();
+                    continue;
+                }
+
+                //anything that didn't fit is dropped, the History still has it
+                if(failed)
+                    break;
+            }
+
+            _batchCount = 0;
+        }
+
+        /*
+            Calls visit(const HistorySample&) for every record from..to (inclusive) that is on flash, oldest first.
+            Records still in the batch aren't included.
+            returns the number of records visited
+        */
+        template<typename Visitor>
+        uint32_t Read(uint32_t from, uint32_t to, Visitor visit)
+        {
+            LogSegment segments[SENSORS_LOG_SEGMENTS];
+            uint8_t segmentCount;
+            uint32_t visited = 0;
+
+            if(_fs == nullptr)
+                return 0;
+
+            portENTER_CRITICAL(&_lock);
+            segmentCount = _segmentCount;
+            memcpy(segments, _segments, segmentCount * sizeof(LogSegment));
+            portEXIT_CRITICAL(&_lock);
+
+            for(uint8_t i = 0; i < segmentCount; i++)
+            {
+                const LogSegment& segment = segments[i];
+
+                if(segment.records == 0 || segment.lastTime < from || segment.firstTime > to)
+                    continue;
+
+                char path[32];
+                SegmentPath(segment.id, path);
+                //deleted since the index was copied, it was the oldest anyway
+                File file = _fs->open(path, "r");
+
+                if(!file)
+                    continue;
+
+                LogRecord records[8];
+                uint32_t index = FindFirst(file, segment, from);
+                bool done = !file.seek(index * sizeof(LogRecord));
+
+                while(!done && index < segment.records)
+                {
+                    size_t count = file.read((uint8_t*)records, sizeof(records)) / sizeof(LogRecord);
+
+                    if(count == 0)
+                        break;
+
+                    for(size_t r = 0; r < count && index < segment.records; r++, index++)
+                    {
+                        const LogRecord& record = records[r];
+
+                        if(!IsValid(record) || record.time > to)
+                        {
+                            done = true;
+                            break;
+                        }
+
+                        HistorySample sample;
+                        sample.time = record.time;
+
+                        for(uint8_t s = 0; s < SENSOR_COUNT; s++)
+                            sample.values[s] = (record.skipped & (1 << s)) == 0 && record.errors[s] == Ezo_board::SUCCESS ? record.values[s] : NAN;
+
+                        visit(sample);
+                        visited++;
+                    }
+                }
+
+                file.close();
+            }
+
+            return visited;
+        }
+
+        /*
+            Writes the size of the log and the flash traffic in the Prometheus text format
+        */
+        void WriteMetrics(Print& out)
+        {
+            uint32_t records = 0;
+            uint8_t segmentCount;
+
+            portENTER_CRITICAL(&_lock);
+            segmentCount = _segmentCount;
+
+            for(uint8_t i = 0; i < segmentCount; i++)
+                records += _segments[i].records;
+
+            portEXIT_CRITICAL(&_lock);
+
+            out.println("# TYPE log_segments gauge");
+            SimpleWeb::Printf(out, "log_segments %u\n", (unsigned int)segmentCount);
+            out.println("# TYPE log_segment_limit gauge");
+            SimpleWeb::Printf(out, "log_segment_limit %u\n", (unsigned int)_segmentLimit);
+            out.println("# TYPE log_records gauge");
+            SimpleWeb::Printf(out, "log_records %u\n", (unsigned int)records);
+            out.println("# TYPE log_written_bytes_total counter");
+            SimpleWeb::Printf(out, "log_written_bytes_total %u\n", (unsigned int)_bytesWritten.Value());
+            out.println("# TYPE log_write_errors_total counter");
+            SimpleWeb::Printf(out, "log_write_errors_total %u\n", (unsigned int)_writeErrors.Value());
+            out.println("# TYPE log_torn_records_total counter");
+            SimpleWeb::Printf(out, "log_torn_records_total %u\n", (unsigned int)_tornRecords.Value());
+        }
+    };
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+#include "Devices.h"
+
+namespace Sensors
+{
+    //bit mask of every SensorId
+    static const uint8_t ALL_SENSORS = (1 << SENSOR_COUNT) - 1;
+
+    /*
+        Everything from one complete acquisition cycle
+    */
+    struct ReadingSnapshot
+    {
+        //incremented every time a cycle completes, 0 means nothing has been read yet
+        uint32_t cycle;
+        //millis() when the cycle completed
+        uint32_t timestamp;
+        //as read from the boards
+        float values[SENSOR_COUNT];
+        //after Conditioning, what /data shows and decisions are made on
+        float filtered[SENSOR_COUNT];
+        //Ezo_board::errors from the last read of each sensor
+        uint8_t errors[SENSOR_COUNT];
+        //bit mask of SensorId read in this cycle, the others still have the value and error of their last read
+        uint8_t sampled;
+        //bit mask of SensorId whose read Conditioning threw out, filtered still has the value from before it
+        uint8_t rejected;
+    };
+}
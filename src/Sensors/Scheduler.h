@@ -0,0 +1,208 @@
+#pragma once
+#include <Arduino.h>
+#include <math.h>
+#include "Devices.h"
+#include "ReadingSnapshot.h"
+#include "SeqLock.h"
+
+namespace Sensors
+{
+    static_assert(SENSOR_COUNT <= 8, "the scheduler keeps the probes in a bit mask");
+
+    /*
+        How one probe is scheduled, all times in milliseconds
+    */
+    struct SensorPolicy
+    {
+        //read this often while the reading is moving
+        uint32_t minInterval;
+        //back off to this while it's flat
+        uint32_t maxInterval;
+        //change per minute that counts as moving
+        float activeRate;
+    };
+
+    struct SchedulePolicy
+    {
+        SensorPolicy sensors[SENSOR_COUNT];
+    };
+
+    /*
+        Where each probe's schedule is at, for GET /schedule
+    */
+    struct ScheduleState
+    {
+        uint32_t intervals[SENSOR_COUNT];
+        //change per minute between the last two reads
+        float rates[SENSOR_COUNT];
+    };
+
+    /*
+        Gives every probe its own read interval.
+        A probe whose reading changed faster than its activeRate since the last read goes straight to
+        its minInterval, every flat read after that doubles the interval up to the maxInterval. A quiet
+        pool is read about once a minute and a chemistry change every few seconds.
+        A read Conditioning threw out is also read again at the minInterval, it's either a glitch or the
+        start of a step that the filter only takes once a few more reads agree with it.
+
+        Probes that are temperature compensated read the temperature probes in the same cycle, so PH
+        always gets a fresh RTD reading.
+
+        Due() and Completed() are only called from the acquisition side. The policy is set from the
+        web task and handed over through a SeqLock, so it can be changed at runtime.
+        Nothing in here touches the bus or the clock, so it can be replayed against a recorded trace.
+    */
+    class Scheduler
+    {
+        public:
+        static const uint32_t DEFAULT_MIN_INTERVAL = 5000;
+        static const uint32_t DEFAULT_MAX_INTERVAL = 60000;
+
+        private:
+        SeqLock<SchedulePolicy> _policy;
+        SeqLock<ScheduleState> _state;
+
+        //only touched by the web task
+        SchedulePolicy _requested;
+
+        //only touched by the acquisition side
+        SchedulePolicy _current;
+        ScheduleState _published;
+        unsigned long _due[SENSOR_COUNT];
+        unsigned long _readAt[SENSOR_COUNT];
+        float _values[SENSOR_COUNT];
+        bool _hasValue[SENSOR_COUNT];
+
+        public:
+        Scheduler()
+        {
+            for(uint8_t i = 0; i < SENSOR_COUNT; i++)
+            {
+                _requested.sensors[i].minInterval = DEFAULT_MIN_INTERVAL;
+                _requested.sensors[i].maxInterval = DEFAULT_MAX_INTERVAL;
+                _requested.sensors[i].activeRate = Devices::KindOf(i).activeRate;
+                //start fast until there is something to compare with
+                _published.intervals[i] = DEFAULT_MIN_INTERVAL;
+                _published.rates[i] = 0;
+                _due[i] = 0;
+                _readAt[i] = 0;
+                _values[i] = 0;
+                _hasValue[i] = false;
+            }
+
+            _current = _requested;
+            _policy.Publish(_requested);
+            _state.Publish(_published);
+        }
+
+        /*
+            The probes that should be read in a cycle starting now, as a bit mask of SensorId.
+            returns 0 when nothing is due
+        */
+        uint8_t Due(unsigned long now)
+        {
+            uint8_t due = 0;
+            bool compensated = false;
+
+            //a policy being changed right now is picked up on the next call
+            _policy.TryRead(_current);
+
+            for(uint8_t i = 0; i < SENSOR_COUNT; i++)
+            {
+                if((long)(now - _due[i]) < 0)
+                    continue;
+
+                due |= 1 << i;
+                compensated |= Devices::KindOf(i).Has(CapabilityCompensated);
+            }
+
+            if(compensated)
+            {
+                for(uint8_t i = 0; i < SENSOR_COUNT; i++)
+                {
+                    if(Devices::KindOf(i).Has(CapabilityTemperature))
+                        due |= 1 << i;
+                }
+            }
+
+            return due;
+        }
+
+        /*
+            Works out the next interval of every probe read in the cycle that started at start
+        */
+        void Completed(unsigned long start, uint8_t sensors, const ReadingSnapshot& snapshot)
+        {
+            for(uint8_t i = 0; i < SENSOR_COUNT; i++)
+            {
+                if((sensors & (1 << i)) == 0)
+                    continue;
+
+                const SensorPolicy& policy = _current.sensors[i];
+                uint32_t interval = _published.intervals[i];
+
+                //the filtered value hasn't moved, so it would look flat and back off right when a step needs confirming
+                if((snapshot.rejected & (1 << i)) != 0)
+                {
+                    interval = policy.minInterval;
+                }
+                //a failed read says nothing about the chemistry, try again at the same pace
+                else if(snapshot.errors[i] == Ezo_board::SUCCESS)
+                {
+                    float rate = 0;
+
+                    if(_hasValue[i] && start != _readAt[i])
+                        rate = fabsf(snapshot.filtered[i] - _values[i]) * 60000.0f / (start - _readAt[i]);
+
+                    if(rate > policy.activeRate)
+                        interval = policy.minInterval;
+                    else
+                        interval = interval * 2;
+
+                    _published.rates[i] = rate;
+                    _values[i] = snapshot.filtered[i];
+                    _readAt[i] = start;
+                    _hasValue[i] = true;
+                }
+
+                if(interval < policy.minInterval)
+                    interval = policy.minInterval;
+
+                if(interval > policy.maxInterval)
+                    interval = policy.maxInterval;
+
+                _published.intervals[i] = interval;
+                _due[i] = start + interval;
+            }
+
+            _state.Publish(_published);
+        }
+
+        /*
+            Changes how a probe is scheduled. Only call from the web task.
+            returns false when the intervals don't make sense
+        */
+        bool SetPolicy(uint8_t sensor, const SensorPolicy& policy)
+        {
+            if(policy.minInterval < Devices::KindOf(sensor).readTime || policy.minInterval > policy.maxInterval || policy.activeRate < 0)
+                return false;
+
+            _requested.sensors[sensor] = policy;
+            _policy.Publish(_requested);
+            return true;
+        }
+
+        /*
+            The policy as last set. Only call from the web task.
+        */
+        const SensorPolicy& GetPolicy(uint8_t sensor) const
+        {
+            return _requested.sensors[sensor];
+        }
+
+        void GetState(ScheduleState& state) const
+        {
+            _state.Read(state);
+        }
+    };
+}
@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+namespace Sensors
+{
+    /*
+        Sequence lock for handing a value from one writer to any number of readers on other cores.
+        The writer never waits and readers never block the writer, a reader just tries again if
+        the value changed while it was copying it.
+        T has to be trivially copyable.
+    */
+    template<typename T>
+    class SeqLock
+    {
+        private:
+        static const size_t WORD_COUNT = (sizeof(T) + sizeof(uint32_t) - 1) / sizeof(uint32_t);
+
+        //odd while the writer is in the middle of publishing
+        std::atomic<uint32_t> _sequence;
+        //the value is stored as atomic words so a torn copy is never undefined behaviour
+        std::atomic<uint32_t> _words[WORD_COUNT];
+
+        public:
+        SeqLock() : _sequence(0)
+        {
+            for(size_t i = 0; i < WORD_COUNT; i++)
+                _words[i].store(0, std::memory_order_relaxed);
+        }
+
+        /*
+            Only call from the one writer
+        */
+        void Publish(const T& value)
+        {
+            uint32_t words[WORD_COUNT] = {};
+            memcpy(words, &value, sizeof(T));
+
+            uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+            _sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            for(size_t i = 0; i < WORD_COUNT; i++)
+                _words[i].store(words[i], std::memory_order_relaxed);
+
+            _sequence.store(sequence + 2, std::memory_order_release);
+        }
+
+        /*
+            returns false when the writer changed the value during the copy
+        */
+        bool TryRead(T& value) const
+        {
+            uint32_t words[WORD_COUNT];
+            uint32_t before = _sequence.load(std::memory_order_acquire);
+
+            if(before & 1)
+                return false;
+
+            for(size_t i = 0; i < WORD_COUNT; i++)
+                words[i] = _words[i].load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if(_sequence.load(std::memory_order_relaxed) != before)
+                return false;
+
+            memcpy(&value, words, sizeof(T));
+            return true;
+        }
+
+        /*
+            Copies out a consistent value, only retries while a publish is in progress
+        */
+        void Read(T& value) const
+        {
+            while(!TryRead(value))
+            {
+            }
+        }
+    };
+}
@@ -0,0 +1,72 @@
+#include <stdlib.h>
+#include <atomic>
+#include "Allocations.h"
+
+#ifdef SIMPLEWEB_COUNT_ALLOCATIONS
+
+static std::atomic<uint32_t> allocationCount(0);
+static std::atomic<TaskHandle_t> countedTask(nullptr);
+
+//malloc can be called from any task, only the one set counts
+static void Counted()
+{
+    TaskHandle_t task = countedTask.load(std::memory_order_relaxed);
+
+    if(task != nullptr && xTaskGetCurrentTaskHandle() == task)
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+//the linker sends every call to malloc, calloc and realloc here with -Wl,--wrap=<name>
+extern "C"
+{
+    void* __real_malloc(size_t size);
+    void* __real_calloc(size_t count, size_t size);
+    void* __real_realloc(void* pointer, size_t size);
+
+    void* __wrap_malloc(size_t size)
+    {
+        Counted();
+        return __real_malloc(size);
+    }
+
+    void* __wrap_calloc(size_t count, size_t size)
+    {
+        Counted();
+        return __real_calloc(count, size);
+    }
+
+    void* __wrap_realloc(void* pointer, size_t size)
+    {
+        Counted();
+        return __real_realloc(pointer, size);
+    }
+}
+
+namespace SimpleWeb
+{
+    void Allocations::SetTask(TaskHandle_t task)
+    {
+        countedTask.store(task, std::memory_order_relaxed);
+    }
+
+    uint32_t Allocations::Count()
+    {
+        return allocationCount.load(std::memory_order_relaxed);
+    }
+}
+
+#else
+
+namespace SimpleWeb
+{
+    void Allocations::SetTask(TaskHandle_t task)
+    {
+    }
+
+    uint32_t Allocations::Count()
+    {
+        return 0;
+    }
+}
+
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+#include <Arduino.h>
+#include <stdint.h>
+
+namespace SimpleWeb
+{
+    /*
+        Counts heap allocations so the request path can be checked for them.
+        Only counts when built with SIMPLEWEB_COUNT_ALLOCATIONS and malloc, calloc and realloc
+        wrapped by the linker, see env:featheresp32-profile in platformio.ini. Otherwise it's always 0.
+        Only the task given to SetTask() is counted, the acquisition and WiFi tasks allocate on their own
+        time and would show up in whatever request was in flight. Nothing is counted until it's set.
+    */
+    class Allocations
+    {
+        public:
+        static void SetTask(TaskHandle_t task);
+        static uint32_t Count();
+    };
+}
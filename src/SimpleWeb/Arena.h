@@ -0,0 +1,111 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+//scratch memory a handler can take from while it answers one request
+#ifndef SIMPLEWEB_ARENA_SIZE
+#define SIMPLEWEB_ARENA_SIZE 4096
+#endif
+
+namespace SimpleWeb
+{
+    /*
+        Bump allocator in static memory, everything taken from it is given back at once by Reset().
+        The router resets it after every response, so a handler can take what it needs without touching
+        the heap or the web task's stack, and nothing it took can outlive the request.
+        When it runs out Allocate() returns nullptr, it never falls back to the heap.
+    */
+    class Arena
+    {
+        private:
+        static const size_t ALIGNMENT = 8;
+
+        alignas(ALIGNMENT) uint8_t _buffer[SIMPLEWEB_ARENA_SIZE];
+        size_t _used;
+        //most that was taken for a single request
+        size_t _peak;
+        uint32_t _failures;
+
+        public:
+        Arena() : _used(0), _peak(0), _failures(0)
+        {
+        }
+
+        /*
+            returns nullptr when there isn't enough left
+        */
+        void* Allocate(size_t size)
+        {
+            size_t start = (_used + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+            if(size > SIMPLEWEB_ARENA_SIZE - start)
+            {
+                Serial.printf("Arena can't fit %u bytes, %u used\n", (unsigned int)size, (unsigned int)_used);
+                _failures++;
+                return nullptr;
+            }
+
+            _used = start + size;
+
+            if(_used > _peak)
+                _peak = _used;
+
+            return _buffer + start;
+        }
+
+        void Reset()
+        {
+            _used = 0;
+        }
+
+        size_t Used() const { return _used; }
+
+        size_t Peak() const { return _peak; }
+
+        uint32_t Failures() const { return _failures; }
+
+        static size_t Size() { return SIMPLEWEB_ARENA_SIZE; }
+    };
+
+    /*
+        Lets ArduinoJson take a document's memory from an Arena
+    */
+    class ArenaAllocator
+    {
+        private:
+        Arena* _arena;
+
+        public:
+        ArenaAllocator(Arena& arena) : _arena(&arena)
+        {
+        }
+
+        void* allocate(size_t size)
+        {
+            return _arena->Allocate(size);
+        }
+
+        //given back when the arena is reset
+        void deallocate(void* pointer)
+        {
+        }
+
+        //documents are never grown or shrunk in place
+        void* reallocate(void* pointer, size_t size)
+        {
+            return nullptr;
+        }
+    };
+
+    /*
+        JsonDocument in the request's arena, ex: ArenaJsonDocument doc(1024, *request.arena);
+        Its capacity is 0 when the arena is full, check with capacity() before using it.
+    */
+    class ArenaJsonDocument : public BasicJsonDocument<ArenaAllocator>
+    {
+        public:
+        ArenaJsonDocument(size_t capacity, Arena& arena) : BasicJsonDocument<ArenaAllocator>(capacity, ArenaAllocator(arena))
+        {
+        }
+    };
+}
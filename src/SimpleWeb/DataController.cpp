@@ -1,237 +1,996 @@
 #pragma once
 #include <ArduinoJson.h>
 #include "Router.h"
+#include "Arena.h"
+#include "ResponseCache.h"
+#include "EventStream.h"
+#include "LongPoll.h"
+#include "Encoding.h"
+#include "Metrics.h"
 #include "IController.h"
 #include <Ezo_i2c_util.h>                                        //brings in common print statements
 #include <Ezo_i2c.h> //include the EZO I2C library from https://github.com/Atlas-Scientific/Ezo_I2c_lib
 #include <iot_cmd.h>
+#include "../Sensors/Acquisition.h"
+#include "../Sensors/CommandQueue.h"
+#include "../Sensors/Conditioning.h"
+#include "../Sensors/Dosing.h"
+#include "../Sensors/History.h"
+#include "../Sensors/ReadingLog.h"
+#include "../Sensors/ReadingSnapshot.h"
+#include "../Sensors/SeqLock.h"
+#include "../Sensors/Scheduler.h"
 
 using namespace std;
 
 
 namespace SimpleWeb
 {
-    class DataController: public IController
+    class DataController: public IMetrics
     {
         private:        
-        Ezo_board PH;
-        Ezo_board ORP;
-        Ezo_board RTD;
-        int deviceLength;
-        bool okToGetData;
+        //biggest /data body, every probe as "NAME":-1.234567e+38, so adding a probe to the registry can't overflow it
+        static const size_t DATA_BODY_SIZE = 2 + Sensors::PROBE_NAMES_SIZE + Sensors::SENSOR_COUNT * 20;
+        static const size_t DATA_DOCUMENT_SIZE = JSON_OBJECT_SIZE(Sensors::SENSOR_COUNT);
+        //the status line and headers are well under 192 bytes
+        static const size_t DATA_RESPONSE_SIZE = 192 + DATA_BODY_SIZE;
+        static_assert(SIMPLEWEB_EVENT_SIZE >= DATA_BODY_SIZE + 48, "a reading event doesn't fit in SIMPLEWEB_EVENT_SIZE");
 
-        //enable pins for each circuit
-        const int EN_PH = 12;
-        const int EN_ORP = 27;
-        const int EN_RTD = 15;
-        const int EN_AUX = 33;
+        //commands from POST /CMD waiting for the acquisition side
+        Sensors::CommandQueue commands;
+        //owns the I2C bus, everything that talks to the boards goes through it
+        Sensors::Acquisition acquisition;
+        //doses through the command queue on every cycle that reads its probe
+        Sensors::Dosing dosing;
+        //filters out the noise before a reading is used, written by the acquisition side
+        Sensors::Conditioning conditioning;
+        //last complete cycle, written by the acquisition side and read by GET /data?detail=1 on the web task
+        Sensors::SeqLock<Sensors::ReadingSnapshot> readings;
+        uint32_t cycle = 0;
+        //copy of the last cycle for the acquisition side
+        Sensors::ReadingSnapshot latest = {};
+        //every cycle for GET /history, written by the acquisition side
+        Sensors::History history;
+        //every cycle on flash so it survives a reboot, written by the acquisition side
+        Sensors::ReadingLog readingLog;
+        //added to the uptime so the time carries on from the log after a reboot
+        uint32_t timeBase = 0;
+        //GET /data rendered once per cycle by the acquisition side
+        ResponseCache<DATA_RESPONSE_SIZE> dataResponses[ENCODING_COUNT];
+        bool dataStale = true;
+        //GET /stream, one event per cycle
+        EventStream stream;
+        //GET /data?since=&wait= clients waiting for the next cycle
+        LongPoll polls;
+        //how long each ReadData call takes in microseconds, it should never block
+        Histogram tickTimes;
+        //how often each probe is read, tunable through /schedule
+        Sensors::Scheduler scheduler;
+        //probes being read in the running cycle and when it started
+        uint8_t cycleSensors = 0;
+        unsigned long cycleStart = 0;
 
-        //an array of boards used for sending commands to all or specific boards
-        Ezo_board* devicePointers[3];
- 
-        Ezo_board* findDevice(string name)
+        static const char* DeviceName(uint8_t device)
         {
-            for (uint8_t i = 0; i < deviceLength; i++) 
-            {
-                if (name == devicePointers[i]->get_name()) 
-                    return devicePointers[i]; 
-            }
+            return Sensors::Devices::Info(device).name;
+        }
 
-            return nullptr;
+        /*
+            Seconds since boot, doesn't wrap like millis()
+        */
+        static uint32_t Uptime()
+        {
+            return esp_timer_get_time() / 1000000;
+        }
+
+        /*
+            Seconds the board has been up, counting every boot the log remembers.
+            The history and the log are both kept in this time.
+        */
+        uint32_t Now() const
+        {
+            return timeBase + Uptime();
         }
         
 
         public:
-        DataController(Ezo_board &ph, Ezo_board &orp, Ezo_board &rtd): 
-            PH(ph),
-            ORP(orp),
-            RTD(rtd),
-            devicePointers {&PH, &ORP, &RTD},
-            deviceLength(sizeof(devicePointers)/sizeof(devicePointers[0])),
-            okToGetData(true)
+        /*
+            Reads every probe in the device registry and sends commands to any board in it
+        */
+        DataController(): 
+            acquisition(commands),
+            dosing(commands)
         {
+            static const uint32_t tickBounds[] = {10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000};
+            tickTimes.SetBounds(tickBounds);
 
         }
 
+        /*
+            Sets up the dosing controller, call from setup() before the web task starts.
+            returns false when the policy doesn't make sense
+        */
+        bool SetDosing(const Sensors::DosingPolicy& policy)
+        {
+            return dosing.SetPolicy(policy);
+        }
+
+        /*
+            Starts logging to the file system and picks up the dosing count from before a reboot,
+            call from setup() once it's mounted. capacity is the size of the partition in bytes
+        */
+        void Begin(fs::FS& fs, size_t capacity)
+        {
+            dosing.Begin(fs, millis());
+
+            if(readingLog.Begin(fs, capacity))
+                timeBase = readingLog.LastTime() + 1;
+        }
+
   
 
         /*
-            Reads the data from the sensors and stores them
+            Reads the data from the sensors and stores them.
+            Doesn't block, call it from loop() as often as possible.
         */
         void ReadData()
         {
-            float rtd;
-            float ph;
-            float orp;
-
-            if(okToGetData)
-            {
-                Serial.printf("\nGetting %s\n", RTD.get_name());
-                    
-                RTD.send_read_cmd();
-                delay(1000);
-                receive_and_print_reading(RTD); 
-                if ((RTD.get_error() == Ezo_board::SUCCESS) && (RTD.get_last_received_reading() > -1000.0)) 
-                { 
-                    //if the temperature reading has been received and it is valid
-                    PH.send_cmd_with_num("T,", RTD.get_last_received_reading());
-                    delay(1000);
-                    rtd = RTD.get_last_received_reading();
-                } 
-                else 
-                {                                                                                      //if the temperature reading is invalid
-                    PH.send_cmd_with_num("T,", 25.0);  
-                    delay(1000);                                                         //send default temp = 25 deg C to PH sensor
-                    rtd = 25;
+            unsigned long start = micros();
+            unsigned long now = millis();
+
+            if(!acquisition.IsRunning())
+            {
+                uint8_t due = scheduler.Due(now);
+
+                if(due != 0)
+                {
+                    Serial.printf("\nGoing to read %02x\n", due);
+                    cycleSensors = due;
+                    cycleStart = now;
+                    acquisition.Start(now, due);
                 }
+            }
 
-                //send a read command. we use this command instead of PH.send_cmd("R");
-                //to let the library know to parse the reading
-                PH.send_read_cmd();
-                
-                ORP.send_read_cmd();
-                delay(1000);
-
-                Serial.printf("\nGetting %s\n", PH.get_name());
-                receive_and_print_reading(PH);             //get the reading from the PH circuit
-                if (PH.get_error() == Ezo_board::SUCCESS) 
-                    ph = PH.get_last_received_reading();
-                else
-                    PH.get_error();
+            if(acquisition.Tick(now))
+            {
+                Serial.printf("Read cycle took %lu ms\n", acquisition.CycleTime());
 
-                Serial.printf("\nGetting %s\n", ORP.get_name());
-                receive_and_print_reading(ORP);             //get the reading from the ORP circuit
-                if (ORP.get_error() == Ezo_board::SUCCESS) 
-                    orp = ORP.get_last_received_reading();
-                else
-                    ORP.get_error();
+                Sensors::ReadingSnapshot snapshot;
+                acquisition.GetReadings(snapshot);
+                conditioning.Add(cycleSensors, snapshot);
+                snapshot.cycle = ++cycle;
+                snapshot.timestamp = now;
+                readings.Publish(snapshot);
+                scheduler.Completed(cycleStart, cycleSensors, snapshot);
+                dosing.Update(now, cycleSensors, snapshot);
+                uint32_t time = Now();
+                history.Append(time, snapshot);
+                readingLog.Append(time, snapshot);
+                latest = snapshot;
+                dataStale = true;
+                PublishReading();
             }
+
+            //retried on the next tick when the web task is still sending the spare buffer
+            if(dataStale)
+                dataStale = !RenderData();
+
+            tickTimes.Observe(micros() - start);
+        }
+
+        void WriteMetrics(Print& out)
+        {
+            acquisition.WriteMetrics(out);
+            out.println("# TYPE acquisition_tick_duration_microseconds histogram");
+            tickTimes.Write(out, "acquisition_tick_duration_microseconds", "");
+            out.println("# TYPE acquisition_cycles_total counter");
+            Printf(out, "acquisition_cycles_total %u\n", (unsigned int)cycle);
+            history.WriteMetrics(out);
+            readingLog.WriteMetrics(out);
+            stream.WriteMetrics(out);
+            polls.WriteMetrics(out);
+            conditioning.WriteMetrics(out);
+            dosing.WriteMetrics(out);
+
+            Sensors::ScheduleState schedule;
+            scheduler.GetState(schedule);
+            out.println("# TYPE sensor_read_interval_milliseconds gauge");
+
+            for(uint8_t i = 0; i < Sensors::SENSOR_COUNT; i++)
+                Printf(out, "sensor_read_interval_milliseconds{device=\"%s\"} %u\n", DeviceName(i), (unsigned int)schedule.intervals[i]);
+        }
+
+        /*
+            Pushes the probes read in the latest cycle to the /stream subscribers, the web task does the sending
+        */
+        void PublishReading()
+        {
+            char data[SIMPLEWEB_EVENT_SIZE];
+            StaticJsonDocument<DATA_DOCUMENT_SIZE> doc;
+
+            FillData(doc, latest.sampled);
+            serializeJson(doc, data, sizeof(data));
+            stream.Publish("reading", data);
+        }
+
+        /*
+            Sends new readings to the /stream subscribers and the clients waiting on /data, call from the web task as often as possible
+        */
+        void Check()
+        {
+            stream.Check();
+            polls.Check(dataResponses);
+        }
+
+        /*
+            The filtered value of the probes in the bit mask of SensorId
+        */
+        void FillData(JsonDocument& doc, uint8_t sensors)
+        {
+            for(uint8_t i = 0; i < Sensors::SENSOR_COUNT; i++)
+            {
+                if((sensors & (1 << i)) != 0)
+                    doc[DeviceName(i)] = latest.filtered[i];
+            }
+        }
+
+        /*
+            Renders the whole GET /data response for the latest cycle into the cache of every encoding.
+            returns false when a cache couldn't be written to yet
+        */
+        bool RenderData()
+        {
+            StaticJsonDocument<DATA_DOCUMENT_SIZE> doc;
+            FillData(doc, Sensors::ALL_SENSORS);
+
+            for(uint8_t i = 0; i < ENCODING_COUNT; i++)
+            {
+                if(!RenderData(doc, (Encoding)i))
+                    return false;
+            }
+
+            return true;
+        }
+
+        bool RenderData(const JsonDocument& doc, Encoding encoding)
+        {
+            ResponseCache<DATA_RESPONSE_SIZE>& cache = dataResponses[encoding];
+            char* buffer = cache.BeginRender();
+            size_t size = cache.Capacity();
+
+            if(buffer == nullptr)
+                return false;
+
+            size_t bodyLength = Encoder::Measure(doc, encoding);
+            // HTTP headers always start with a response code (e.g. HTTP/1.1 200 OK)
+            // and a content-type so the client knows what's coming, then a blank line.
+            // The cycle is the ETag so a poller that has it already gets a 304
+            int headerLength = snprintf(buffer, size,
+                "HTTP/1.1 200 OK\r\n"
+                "Content-type:%s\r\n"
+                "Content-Length: %u\r\n"
+                "ETag: \"%u\"\r\n"
+                "Cache-Control: no-cache\r\n"
+                "Vary: Accept\r\n"
+                "Connection: close\r\n"
+                "\r\n", Encoder::ContentType(encoding), (unsigned int)bodyLength, (unsigned int)latest.cycle);
+
+            if(headerLength < 0 || headerLength + bodyLength >= size)
+            {
+                Serial.printf("data response doesn't fit in %u bytes\n", (unsigned int)size);
+                return true;
+            }
+
+            Encoder::Serialize(doc, encoding, buffer + headerLength, size - headerLength);
+            cache.Publish(headerLength + bodyLength, latest.cycle);
+            return true;
         }
 
         
-        bool Handler(WiFiClient& client, const String& header)
+        /*
+            Adds the routes this controller answers to the router
+        */
+        void AddRoutes(Router& router)
+        {
+            router.AddRoute<DataController, &DataController::PostCommand>("POST", "/CMD", this);
+            router.AddRoute<DataController, &DataController::GetCommand>("GET", "/CMD/*", this);
+            router.AddRoute<DataController, &DataController::GetHelp>("GET", "/HELP", this);
+            router.AddRoute<DataController, &DataController::GetData>("GET", "/data", this);
+            router.AddRoute<DataController, &DataController::GetHistory>("GET", "/history", this);
+            router.AddRoute<DataController, &DataController::GetSchedule>("GET", "/schedule", this);
+            router.AddRoute<DataController, &DataController::PostSchedule>("POST", "/schedule", this);
+            router.AddRoute<DataController, &DataController::GetDosing>("GET", "/dosing", this);
+            router.AddRoute<DataController, &DataController::PostDosing>("POST", "/dosing", this);
+            stream.AddRoutes(router, "/stream");
+        }
+
+        /*
+            Uppercases the command and trims the spaces off it for easier comparisions
+            returns false when it's empty or too long
+        */
+        static bool NormalizeCommand(const char* command, char (&normalized)[Sensors::Job::COMMAND_SIZE])
         {
-            if(header.indexOf("POST /CMD HTTP/1.1") >= 0)
+            while(isspace((unsigned char)*command))
+                command++;
+
+            size_t length = strlen(command);
+
+            while(length > 0 && isspace((unsigned char)command[length - 1]))
+                length--;
+
+            if(length == 0 || length >= sizeof(normalized))
+                return false;
+
+            for(size_t i = 0; i < length; i++)
+                normalized[i] = toupper((unsigned char)command[i]);
+
+            normalized[length] = '\0';
+            return true;
+        }
+
+        /*
+            POST /CMD queues commands for the devices, either one ex: {"device":"PH","cmd":"cal,mid,7"}
+            or an array of them ex: [{"device":"PH","cmd":"i"},{"device":"ORP","cmd":"i"},{"device":"RTD","cmd":"i"}]
+            Responds with 202 and the job ids straight away, GET /CMD/<id> has the result.
+            The devices are on their own I2C addresses so commands for different devices run at the same time,
+            a batch across all of them is done in about 1.2s. GET /CMD/<id>,<id>,... gets them all back together.
+            Nothing is queued if any of the batch is bad or there isn't room for all of it.
+        */
+        void PostCommand(const Request& request, ResponseWriter& writer)
+        {
+            //room for the strings of the largest body that will be accepted
+            ArenaJsonDocument doc(JSON_ARRAY_SIZE(SENSORS_COMMAND_QUEUE_SIZE) + SENSORS_COMMAND_QUEUE_SIZE * JSON_OBJECT_SIZE(2) + SIMPLEWEB_MAX_BODY_SIZE, *request.arena);
+            StaticJsonDocument<JSON_OBJECT_SIZE(2) + JSON_ARRAY_SIZE(SENSORS_COMMAND_QUEUE_SIZE) + 64> response;
+            int devices[SENSORS_COMMAND_QUEUE_SIZE];
+            char cmds[SENSORS_COMMAND_QUEUE_SIZE][Sensors::Job::COMMAND_SIZE];
+            size_t count = 0;
+
+            if(!HasCapacity(doc, writer))
+                return;
+
+            //the router has already read the whole body
+            DeserializationError error = deserializeJson(doc, request.body, request.bodyLength);
+
+            if(error)
             {
-                okToGetData = false;
-                String cmd;
-                StaticJsonDocument<256> doc;
-                String s = client.readStringUntil('\n');              
-                DeserializationError error = deserializeJson(doc, s.c_str());
+                response["error"] = error.c_str();
+                WriteDocument(request, writer, 400, response);
+                return;
+            }
 
-                okToGetData = false;
+            //a single command is a batch of one
+            bool isBatch = doc.is<JsonArray>();
+            size_t total = isBatch ? doc.size() : 1;
 
-                cmd = doc.as<String>();
-                
-                Ezo_board* board = findDevice(doc["device"]);
+            if(total == 0)
+            {
+                response["error"] = "Empty batch";
+                WriteDocument(request, writer, 400, response);
+                return;
+            }
+
+            if(total > SENSORS_COMMAND_QUEUE_SIZE)
+            {
+                response["error"] = "Too many commands in the batch";
+                response["max"] = SENSORS_COMMAND_QUEUE_SIZE;
+                WriteDocument(request, writer, 400, response);
+                return;
+            }
 
-                if(board == nullptr)
+            for(; count < total; count++)
+            {
+                JsonObject item = isBatch ? doc[count].as<JsonObject>() : doc.as<JsonObject>();
+                devices[count] = Sensors::Devices::Find(item["device"] | "");
+
+                if(devices[count] < 0)
                 {
-                    StaticJsonDocument<100> response;
                     response["error"] = "Device not found";
-                    
-                    serializeJson(response, client);
+                    response["index"] = count;
+                    WriteDocument(request, writer, 404, response);
+                    return;
                 }
-                else
+
+                if(!NormalizeCommand(item["cmd"] | "", cmds[count]))
                 {
-                    StaticJsonDocument<100> response;
-                    
-                    cmd.toUpperCase();                     //turn the command to uppercase for easier comparisions
-                    cmd.trim();
-                    Serial.printf("Received command=%s\n", cmd);
-                    
-                    board->send_cmd(cmd.c_str());
-                    delay(1200);
-
-                     switch (board->get_error()) {             //switch case based on what the response code is.
-                        case Ezo_board::SUCCESS:
-                            char receive_buffer[32];
-                            Serial.println("Receiving response");
-                            board->receive_cmd(receive_buffer, 32);
-                            response["response"] = receive_buffer;
-
-                            break;
-                        case Ezo_board::FAIL:
-                            response["error"] = "Device responded with a FAIL";
-                            break;
-
-                        case Ezo_board::NOT_READY:
-                            response["error"] = "the command has not yet been finished calculating";
-                            break;
-                        case Ezo_board::NO_DATA:
-                            response["error"] = "the sensor has no data to send.";
-                            break;
-                    }
-
-                    //write out the response
-                    serializeJson(response, client);
-                }               
-
-                okToGetData = true;
-
-                client.println("HTTP/1.1 200 OK");
-                client.println("Content-type:text/json");
-                client.println("Connection: close");
-                client.println();
+                    response["error"] = "cmd is missing or too long";
+                    response["index"] = count;
+                    WriteDocument(request, writer, 400, response);
+                    return;
+                }
+            }
+
+            if(commands.Available() < count)
+            {
+                response["error"] = "Too many commands waiting";
+                WriteDocument(request, writer, 503, response);
+                return;
+            }
+
+            //the acquisition side owns the bus, it sends each command as soon as its device is free
+            if(!isBatch)
+            {
+                Serial.printf("Received command=%s\n", cmds[0]);
+                response["id"] = commands.Submit(devices[0], cmds[0]);
+                WriteDocument(request, writer, 202, response);
+                return;
+            }
+
+            JsonArray ids = response.createNestedArray("ids");
+
+            for(size_t i = 0; i < count; i++)
+            {
+                Serial.printf("Received command=%s for %s\n", cmds[i], DeviceName(devices[i]));
+                ids.add(commands.Submit(devices[i], cmds[i]));
+            }
+
+            WriteDocument(request, writer, 202, response);
+        }
+
+        /*
+            Fills in the status of a job and the device's response once it's done
+            returns false when the job doesn't exist anymore
+        */
+        bool FillCommand(uint32_t id, JsonObject response)
+        {
+            Sensors::JobResult job;
+
+            if(!commands.Find(id, job))
+            {
+                response["id"] = id;
+                response["error"] = "Command not found";
+                return false;
+            }
+
+            response["id"] = job.id;
+            response["device"] = DeviceName(job.device);
+            response["cmd"] = job.command;
+            response["status"] = Sensors::CommandQueue::StatusName(job.status);
+
+            if(job.status == Sensors::JobDone)
+            {
+                switch (job.error) {             //switch case based on what the response code is.
+                    case Ezo_board::SUCCESS:
+                        response["response"] = job.response;
+                        break;
+                    case Ezo_board::FAIL:
+                        response["error"] = "Device responded with a FAIL";
+                        break;
+
+                    case Ezo_board::NOT_READY:
+                        response["error"] = "the command has not yet been finished calculating";
+                        break;
+                    case Ezo_board::NO_DATA:
+                        response["error"] = "the sensor has no data to send.";
+                        break;
+                }
+            }
+
+            return true;
+        }
+
+        /*
+            GET /CMD/<id> returns the status of a queued command and the device's response once it's done.
+            GET /CMD/<id>,<id>,... returns an array of them, ex: the ids from a batch
+        */
+        void GetCommand(const Request& request, ResponseWriter& writer)
+        {
+            const char* ids = strrchr(request.path, '/') + 1;
+
+            if(strchr(ids, ',') == nullptr)
+            {
+                StaticJsonDocument<JSON_OBJECT_SIZE(6) + 2 * Sensors::Job::COMMAND_SIZE> response;
+                bool found = FillCommand(strtoul(ids, nullptr, 10), response.to<JsonObject>());
+                WriteDocument(request, writer, found ? 200 : 404, response);
+                return;
+            }
+
+            ArenaJsonDocument response(SENSORS_COMMAND_QUEUE_SIZE * (JSON_OBJECT_SIZE(6) + 2 * Sensors::Job::COMMAND_SIZE) + JSON_ARRAY_SIZE(SENSORS_COMMAND_QUEUE_SIZE), *request.arena);
+
+            if(!HasCapacity(response, writer))
+                return;
+
+            JsonArray results = response.to<JsonArray>();
+
+            for(uint8_t i = 0; i < SENSORS_COMMAND_QUEUE_SIZE && *ids != '\0'; i++)
+            {
+                char* end;
+                uint32_t id = strtoul(ids, &end, 10);
+
+                if(end == ids)
+                    break;
+
+                FillCommand(id, results.createNestedObject());
+                ids = *end == ',' ? end + 1 : end;
+            }
+
+            WriteDocument(request, writer, 200, response);
+        }
+
+        /*
+            Answers with a 503 when the arena couldn't fit the document
+            returns false when the handler should stop there
+        */
+        static bool HasCapacity(const JsonDocument& doc, ResponseWriter& writer)
+        {
+            if(doc.capacity() > 0)
                 return true;
+
+            writer.Send(503);
+            return false;
+        }
+
+        /*
+            Writes the document in the encoding the client asked for, JSON or MessagePack
+        */
+        static void WriteDocument(const Request& request, ResponseWriter& writer, int status, const JsonDocument& doc)
+        {
+            Encoder::Write(writer, status, doc, Encoder::Negotiate(request));
+        }
+
+        /*
+            GET /HELP lists out the commands of every board in the device registry, ex: "PH:cal,mid,7  calibrate to pH 7"
+        */
+        void GetHelp(const Request& request, ResponseWriter& response)
+        {
+            const char* separator = "";
+
+            response.Begin(200, "text/json");
+            response.print("[");
+
+            for(uint8_t i = 0; i < Sensors::DEVICE_COUNT; i++)
+            {
+                const Sensors::KindInfo& kind = Sensors::Devices::KindOf(i);
+
+                for(uint8_t h = 0; h < kind.helpCount; h++)
+                {
+                    response.printf("%s\"%s:%-12s %s\"", separator, DeviceName(i), kind.help[h].command, kind.help[h].description);
+                    separator = ",";
+                }
+            }
+
+            response.print("]");
+            response.End();
+        }
+
+        /*
+            GET /data returns the filtered reading of each device.
+            GET /data?detail=1 returns the raw read, median, filtered value, running stats and last error of each device side by side.
+            The ETag is the cycle, with If-None-Match it's a 304 until the next cycle.
+            GET /data?since=<cycle>&wait=<ms> waits up to wait milliseconds for a cycle newer than since, then it's a 304.
+            A since that isn't the current cycle, older or from before a reboot, gets the current readings straight away.
+        */
+        void GetData(const Request& request, ResponseWriter& response)
+        {
+            Serial.printf("data...\n"); 
+            char detail[4];
+
+            if(request.GetQuery("detail", detail, sizeof(detail)) && strcmp(detail, "0") != 0)
+            {
+                GetDataDetail(request, response);
+                return;
             }
-            else if(header.indexOf("GET /HELP HTTP/1.1") >= 0)
+
+            Encoding encoding = Encoder::Negotiate(request);
+            ResponseCache<DATA_RESPONSE_SIZE>& cache = dataResponses[encoding];
+            uint32_t tag = cache.Tag();
+            char etag[16];
+            snprintf(etag, sizeof(etag), "\"%u\"", (unsigned int)tag);
+            const char* match = request.GetHeader("If-None-Match");
+            char value[12];
+
+            if(request.GetQuery("since", value, sizeof(value)))
+            {
+                uint32_t since = strtoul(value, nullptr, 10);
+                unsigned long wait = request.GetQuery("wait", value, sizeof(value)) ? strtoul(value, nullptr, 10) : 0;
+
+                //nothing newer yet, wait for it or say so. A since ahead of the tag is from before a reboot,
+                //the tag started again from 0 so that client gets what's current now
+                if(tag == since)
+                {
+                    if(wait == 0)
+                        SendNotModified(response, etag);
+                    else if(!polls.Wait(response, since, wait, encoding))
+                        response.Send(503);
+
+                    return;
+                }
+            }
+            else if(match != nullptr && tag != 0 && (strcmp(match, "*") == 0 || strstr(match, etag) != nullptr))
+            {
+                SendNotModified(response, etag);
+                return;
+            }
+
+            //rendered once per cycle by ReadData, so this is a single write
+            if(cache.Write(response) == 0)
+                response.Send(503);
+        }
+
+        static void SendNotModified(ResponseWriter& response, const char* etag)
+        {
+            response.Begin(304, nullptr);
+            response.Header("ETag", etag);
+            response.End();
+        }
+
+        /*
+            Name of an Ezo_board::errors for the responses
+        */
+        static const char* ErrorName(uint8_t error)
+        {
+            switch(error)
+            {
+                case Ezo_board::SUCCESS: return "ok";
+                case Ezo_board::FAIL: return "fail";
+                case Ezo_board::NOT_READY: return "not ready";
+                case Ezo_board::NO_DATA: return "no data";
+                default: return "not a read";
+            }
+        }
+
+        void GetDataDetail(const Request& request, ResponseWriter& response)
+        {
+            ArenaJsonDocument doc(Sensors::SENSOR_COUNT * JSON_OBJECT_SIZE(10) + JSON_OBJECT_SIZE(Sensors::SENSOR_COUNT), *request.arena);
+            Sensors::ConditioningState state;
+            Sensors::ReadingSnapshot snapshot;
+
+            if(!HasCapacity(doc, response))
+                return;
+
+            conditioning.GetState(state);
+            readings.Read(snapshot);
+
+            for(uint8_t i = 0; i < Sensors::SENSOR_COUNT; i++)
+            {
+                const Sensors::SignalState& signal = state.sensors[i];
+                JsonObject sensor = doc.createNestedObject(DeviceName(i));
+                sensor["raw"] = signal.raw;
+                sensor["median"] = signal.median;
+                sensor["filtered"] = signal.filtered;
+                sensor["mean"] = signal.mean;
+                sensor["deviation"] = signal.deviation;
+                sensor["min"] = signal.min;
+                sensor["max"] = signal.max;
+                sensor["count"] = signal.count;
+                sensor["rejected"] = signal.rejected;
+                //how the last read of it went
+                sensor["error"] = ErrorName(snapshot.errors[i]);
+            }
+
+            WriteDocument(request, response, 200, doc);
+        }
+
+        /*
+            GET /history?sensor=PH&from=0&to=3600&step=60 returns the stored readings of one device.
+            from and to are in the time of Now() (the response has "now"), they default to everything.
+            The last few days come from RAM, add source=log to read further back from flash.
+            With a step each point is [start, min, max, avg] of that many seconds, without one it's [time, value].
+            The points are written as they're decoded so there's never a big document in memory.
+        */
+        void GetHistory(const Request& request, ResponseWriter& response)
+        {
+            char value[16];
+            StaticJsonDocument<64> error;
+
+            if(!request.GetQuery("sensor", value, sizeof(value)))
+            {
+                error["error"] = "sensor is required";
+                WriteDocument(request, response, 400, error);
+                return;
+            }
+
+            int device = Sensors::Devices::Find(value);
+
+            if(device < 0 || device >= Sensors::SENSOR_COUNT)
+            {
+                error["error"] = "Device not found";
+                WriteDocument(request, response, 404, error);
+                return;
+            }
+
+            uint32_t now = Now();
+            bool fromLog = request.GetQuery("source", value, sizeof(value)) && strcmp(value, "log") == 0;
+            uint32_t from = request.GetQuery("from", value, sizeof(value)) ? strtoul(value, nullptr, 10) : 0;
+            uint32_t to = request.GetQuery("to", value, sizeof(value)) ? strtoul(value, nullptr, 10) : now;
+            uint32_t step = request.GetQuery("step", value, sizeof(value)) ? strtoul(value, nullptr, 10) : 0;
+            Encoding encoding = Encoder::Negotiate(request);
+
+            if(encoding == EncodingMsgPack)
+            {
+                WriteHistoryMsgPack(response, device, fromLog, now, from, to, step);
+                return;
+            }
+
+            int decimals = Sensors::Devices::KindOf(device).decimals;
+            const char* separator = "";
+
+            response.Begin(200, Encoder::ContentType(encoding));
+            response.Header("Vary", "Accept");
+            response.printf("{\"sensor\":\"%s\",\"now\":%u,\"from\":%u,\"to\":%u,\"step\":%u,\"points\":[",
+                DeviceName(device), (unsigned int)now, (unsigned int)from, (unsigned int)to, (unsigned int)step);
+
+            VisitHistory(device, fromLog, from, to, step, [&](const HistoryPoint& point)
+            {
+                if(step == 0)
+                    response.printf("%s[%u,%.*f]", separator, (unsigned int)point.time, decimals, point.minimum);
+                else
+                    response.printf("%s[%u,%.*f,%.*f,%.*f]", separator, (unsigned int)point.time,
+                        decimals, point.minimum, decimals, point.maximum, decimals + 1, point.average);
+
+                separator = ",";
+            });
+
+            response.print("]}");
+            response.End();
+        }
+
+        /*
+            One point of GET /history, a reading when there's no step
+        */
+        struct HistoryPoint
+        {
+            uint32_t time;
+            float minimum;
+            float maximum;
+            float average;
+        };
+
+        /*
+            Calls visitor with every point of one device between from and to, or with one point per bucket of step seconds
+        */
+        template<class Visitor>
+        void VisitHistory(uint8_t device, bool fromLog, uint32_t from, uint32_t to, uint32_t step, Visitor visitor)
+        {
+            HistoryPoint point = {};
+            uint32_t count = 0;
+            double sum = 0;
+
+            auto visit = [&](const Sensors::HistorySample& sample)
             {
-                // compute the required size
-                const size_t CAPACITY = JSON_ARRAY_SIZE(8);
+                float reading = sample.values[device];
 
-                // allocate the memory for the document
-                StaticJsonDocument<CAPACITY> doc;
+                if(isnan(reading))
+                    return;
 
-                // create an empty array
-                JsonArray array = doc.to<JsonArray>();
+                if(step == 0)
+                {
+                    HistoryPoint single = {sample.time, reading, reading, reading};
+                    visitor(single);
+                    return;
+                }
 
-                array.add("ph:cal,mid,7     calibrate to pH 7");
-                array.add("ph:cal,low,4     calibrate to pH 4");
-                array.add("ph:cal,high,10   calibrate to pH 10");
-                array.add("ph:cal,clear     clear calibration");
-                array.add("orp:cal,225          calibrate orp probe to 225mV");
-                array.add("orp:cal,clear        clear calibration");
-                array.add("rtd:cal,t            calibrate the temp probe to any temp value");                
-                array.add("rtd:cal,clear        clear calibration");
+                uint32_t start = from + (sample.time - from) / step * step;
 
-                for(int i=0; i < deviceLength; i++)
+                if(count > 0 && start != point.time)
                 {
-                    Serial.printf("device=%s\n", devicePointers[i]->get_name());
+                    point.average = sum / count;
+                    visitor(point);
+                    count = 0;
                 }
-                    
-                // HTTP headers always start with a response code (e.g. HTTP/1.1 200 OK)
-                // and a content-type so the client knows what's coming, then a blank line:
-                client.println("HTTP/1.1 200 OK");
-                client.println("Content-type:text/json");
-                client.println("Connection: close");
-                client.println();
-
-                serializeJson(doc, client); 
-                doc.garbageCollect();
-                return true; 
-            }           
-            else if(header.indexOf("GET /data HTTP/1.1") >= 0)
-            {   
-                StaticJsonDocument<200> doc;      
-                // HTTP headers always start with a response code (e.g. HTTP/1.1 200 OK)
-                // and a content-type so the client knows what's coming, then a blank line:
-                client.println("HTTP/1.1 200 OK");
-                client.println("Content-type:text/json");
-                client.println("Connection: close");
-                client.println(); 
-                
-                Serial.printf("data...\n"); 
-                    
-                for(int i=0; i< deviceLength; i++)
-                    doc[devicePointers[i]->get_name()] = devicePointers[i]->get_last_received_reading();
-                
-                serializeJson(doc, client);
-                doc.garbageCollect();
-                return true;
+
+                if(count == 0)
+                {
+                    point.time = start;
+                    point.minimum = point.maximum = reading;
+                    sum = 0;
+                }
+
+                point.minimum = min(point.minimum, reading);
+                point.maximum = max(point.maximum, reading);
+                sum += reading;
+                count++;
+            };
+
+            if(fromLog)
+                readingLog.Read(from, to, visit);
+            else
+                history.Read(from, to, visit);
+
+            if(count > 0)
+            {
+                point.average = sum / count;
+                visitor(point);
             }
+        }
 
-            return false;
+        /*
+            GET /history in MessagePack, the same map as the JSON with float points.
+            The points array needs its size first, so the history is read twice: once to count and once to write.
+        */
+        void WriteHistoryMsgPack(ResponseWriter& response, uint8_t device, bool fromLog, uint32_t now, uint32_t from, uint32_t to, uint32_t step)
+        {
+            uint32_t total = 0;
+            VisitHistory(device, fromLog, from, to, step, [&](const HistoryPoint& point) { total++; });
+
+            response.Begin(200, Encoder::ContentType(EncodingMsgPack));
+            response.Header("Vary", "Accept");
+
+            MsgPackWriter writer(response);
+            writer.Map(6);
+            writer.String("sensor");
+            writer.String(DeviceName(device));
+            writer.String("now");
+            writer.Unsigned(now);
+            writer.String("from");
+            writer.Unsigned(from);
+            writer.String("to");
+            writer.Unsigned(to);
+            writer.String("step");
+            writer.Unsigned(step);
+            writer.String("points");
+            writer.Array(total);
+
+            uint32_t written = 0;
+
+            VisitHistory(device, fromLog, from, to, step, [&](const HistoryPoint& point)
+            {
+                //a sample that came in between the two reads
+                if(written == total)
+                    return;
+
+                writer.Array(step == 0 ? 2 : 4);
+                writer.Unsigned(point.time);
+                writer.Float(point.minimum);
+
+                if(step != 0)
+                {
+                    writer.Float(point.maximum);
+                    writer.Float(point.average);
+                }
+
+                written++;
+            });
+
+            //the oldest block was recycled between the two reads, keep the array the size it said
+            for(; written < total; written++)
+                writer.Nil();
+
+            response.End();
+        }
+
+        /*
+            GET /schedule returns how each probe is scheduled and how often it's being read right now, in milliseconds
+        */
+        void GetSchedule(const Request& request, ResponseWriter& response)
+        {
+            StaticJsonDocument<Sensors::SENSOR_COUNT * JSON_OBJECT_SIZE(5) + JSON_OBJECT_SIZE(Sensors::SENSOR_COUNT)> doc;
+            Sensors::ScheduleState state;
+            scheduler.GetState(state);
+
+            for(uint8_t i = 0; i < Sensors::SENSOR_COUNT; i++)
+            {
+                const Sensors::SensorPolicy& policy = scheduler.GetPolicy(i);
+                JsonObject sensor = doc.createNestedObject(DeviceName(i));
+                sensor["min"] = policy.minInterval;
+                sensor["max"] = policy.maxInterval;
+                sensor["activeRate"] = policy.activeRate;
+                sensor["interval"] = state.intervals[i];
+                sensor["rate"] = state.rates[i];
+            }
+
+            WriteDocument(request, response, 200, doc);
+        }
+
+        /*
+            POST /schedule changes how a probe is scheduled, ex: {"sensor":"PH","min":5000,"max":60000,"activeRate":0.05}
+            Anything left out stays as it is. activeRate is the change per minute that makes it read every min.
+        */
+        void PostSchedule(const Request& request, ResponseWriter& response)
+        {
+            StaticJsonDocument<JSON_OBJECT_SIZE(4) + 64> doc;
+            StaticJsonDocument<JSON_OBJECT_SIZE(1)> error;
+
+            if(deserializeJson(doc, request.body, request.bodyLength))
+            {
+                error["error"] = "Invalid JSON";
+                WriteDocument(request, response, 400, error);
+                return;
+            }
+
+            int sensor = Sensors::Devices::Find(doc["sensor"] | "");
+
+            if(sensor < 0 || sensor >= Sensors::SENSOR_COUNT)
+            {
+                error["error"] = "Device not found";
+                WriteDocument(request, response, 404, error);
+                return;
+            }
+
+            Sensors::SensorPolicy policy = scheduler.GetPolicy(sensor);
+            policy.minInterval = doc["min"] | policy.minInterval;
+            policy.maxInterval = doc["max"] | policy.maxInterval;
+            policy.activeRate = doc["activeRate"] | policy.activeRate;
+
+            if(!scheduler.SetPolicy(sensor, policy))
+            {
+                error["error"] = "min has to be at least the read time and no more than max";
+                WriteDocument(request, response, 400, error);
+                return;
+            }
+
+            GetSchedule(request, response);
+        }
+
+        /*
+            GET /dosing returns the dosing policy and what the controller is doing, volumes in ml and times in milliseconds
+        */
+        void GetDosing(const Request& request, ResponseWriter& response)
+        {
+            StaticJsonDocument<JSON_OBJECT_SIZE(18)> doc;
+            const Sensors::DosingPolicy& policy = dosing.GetPolicy();
+            Sensors::DosingState state;
+            dosing.GetState(state);
+
+            doc["enabled"] = policy.enabled;
+            doc["sensor"] = DeviceName(policy.sensor);
+            doc["pump"] = DeviceName(policy.pump);
+            doc["above"] = policy.above;
+            doc["target"] = policy.target;
+            doc["hysteresis"] = policy.hysteresis;
+            doc["dose"] = policy.dose;
+            doc["minInterval"] = policy.minInterval;
+            doc["dailyLimit"] = policy.dailyLimit;
+            doc["state"] = Sensors::Dosing::ModeName(state.mode);
+            doc["reason"] = state.reason;
+            doc["value"] = state.value;
+            doc["today"] = state.today;
+            doc["total"] = state.total;
+            doc["doses"] = state.doses;
+            //how long ago, so it doesn't need the board's clock
+            doc["lastDose"] = state.doses == 0 ? 0 : (uint32_t)(millis() - state.lastDose);
+            doc["job"] = state.job;
+
+            WriteDocument(request, response, 200, doc);
+        }
+
+        /*
+            POST /dosing changes the dosing policy, anything left out stays as it is, ex: {"enabled":true,"target":7.4}
+            {"reset":true} lifts a lockout after a pump error.
+        */
+        void PostDosing(const Request& request, ResponseWriter& response)
+        {
+            StaticJsonDocument<JSON_OBJECT_SIZE(10) + 96> doc;
+            StaticJsonDocument<JSON_OBJECT_SIZE(1)> error;
+
+            if(deserializeJson(doc, request.body, request.bodyLength))
+            {
+                error["error"] = "Invalid JSON";
+                WriteDocument(request, response, 400, error);
+                return;
+            }
+
+            Sensors::DosingPolicy policy = dosing.GetPolicy();
+            int sensor = Sensors::Devices::Find(doc["sensor"] | DeviceName(policy.sensor));
+            int pump = Sensors::Devices::Find(doc["pump"] | DeviceName(policy.pump));
+
+            if(sensor < 0 || pump < 0)
+            {
+                error["error"] = "Device not found";
+                WriteDocument(request, response, 404, error);
+                return;
+            }
+
+            policy.enabled = doc["enabled"] | policy.enabled;
+            policy.sensor = sensor;
+            policy.pump = pump;
+            policy.above = doc["above"] | policy.above;
+            policy.target = doc["target"] | policy.target;
+            policy.hysteresis = doc["hysteresis"] | policy.hysteresis;
+            policy.dose = doc["dose"] | policy.dose;
+            policy.minInterval = doc["minInterval"] | policy.minInterval;
+            policy.dailyLimit = doc["dailyLimit"] | policy.dailyLimit;
+
+            if(!dosing.SetPolicy(policy))
+            {
+                error["error"] = "sensor has to be a probe, pump a pump and dose no more than dailyLimit";
+                WriteDocument(request, response, 400, error);
+                return;
+            }
+
+            if(doc["reset"] | false)
+                dosing.Reset();
+
+            GetDosing(request, response);
         }
     };   
     
@@ -0,0 +1,160 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "Request.h"
+#include "ResponseWriter.h"
+
+namespace SimpleWeb
+{
+    enum Encoding
+    {
+        EncodingJson,
+        EncodingMsgPack,
+        ENCODING_COUNT
+    };
+
+    /*
+        Picks the encoding of a response from the Accept header and writes documents in it.
+        JSON unless the client asks for MessagePack, so a browser or curl gets what it always got.
+    */
+    class Encoder
+    {
+        public:
+        static Encoding Negotiate(const Request& request)
+        {
+            if(request.Accepts("application/msgpack") || request.Accepts("application/x-msgpack"))
+                return EncodingMsgPack;
+
+            return EncodingJson;
+        }
+
+        static const char* ContentType(Encoding encoding)
+        {
+            return encoding == EncodingMsgPack ? "application/msgpack" : "text/json";
+        }
+
+        static const char* Name(Encoding encoding)
+        {
+            return encoding == EncodingMsgPack ? "msgpack" : "json";
+        }
+
+        static size_t Measure(const JsonDocument& doc, Encoding encoding)
+        {
+            return encoding == EncodingMsgPack ? measureMsgPack(doc) : measureJson(doc);
+        }
+
+        static size_t Serialize(const JsonDocument& doc, Encoding encoding, char* buffer, size_t size)
+        {
+            return encoding == EncodingMsgPack ? serializeMsgPack(doc, buffer, size) : serializeJson(doc, buffer, size);
+        }
+
+        static void Write(ResponseWriter& response, int status, const JsonDocument& doc, Encoding encoding)
+        {
+            response.Begin(status, ContentType(encoding));
+            response.Header("Vary", "Accept");
+
+            if(encoding == EncodingMsgPack)
+                serializeMsgPack(doc, response);
+            else
+                serializeJson(doc, response);
+
+            response.End();
+        }
+    };
+
+    /*
+        Writes MessagePack by hand for responses that are streamed instead of built as a document, ex: /history.
+        Maps and arrays need their size up front.
+    */
+    class MsgPackWriter
+    {
+        private:
+        Print& _out;
+
+        void Header(uint8_t fix, uint8_t code16, uint32_t size)
+        {
+            if(size < 16)
+            {
+                _out.write((uint8_t)(fix | size));
+                return;
+            }
+
+            if(size <= 0xffff)
+            {
+                uint8_t header[] = {code16, (uint8_t)(size >> 8), (uint8_t)size};
+                _out.write(header, sizeof(header));
+                return;
+            }
+
+            //the 32 bit code always follows the 16 bit one
+            uint8_t header[] = {(uint8_t)(code16 + 1), (uint8_t)(size >> 24), (uint8_t)(size >> 16), (uint8_t)(size >> 8), (uint8_t)size};
+            _out.write(header, sizeof(header));
+        }
+
+        public:
+        MsgPackWriter(Print& out) : _out(out)
+        {
+        }
+
+        void Map(uint32_t size) { Header(0x80, 0xde, size); }
+
+        void Array(uint32_t size) { Header(0x90, 0xdc, size); }
+
+        void String(const char* text)
+        {
+            //up to 255 characters, they're all keys and device names
+            size_t length = strlen(text);
+
+            if(length > 0xff)
+                length = 0xff;
+
+            if(length < 32)
+            {
+                _out.write((uint8_t)(0xa0 | length));
+            }
+            else
+            {
+                uint8_t header[] = {0xd9, (uint8_t)length};
+                _out.write(header, sizeof(header));
+            }
+
+            _out.write((const uint8_t*)text, length);
+        }
+
+        /*
+            The smallest code the value fits, the times in /history are mostly 2 bytes
+        */
+        void Unsigned(uint32_t value)
+        {
+            if(value < 0x80)
+            {
+                _out.write((uint8_t)value);
+            }
+            else if(value <= 0xff)
+            {
+                uint8_t bytes[] = {0xcc, (uint8_t)value};
+                _out.write(bytes, sizeof(bytes));
+            }
+            else if(value <= 0xffff)
+            {
+                uint8_t bytes[] = {0xcd, (uint8_t)(value >> 8), (uint8_t)value};
+                _out.write(bytes, sizeof(bytes));
+            }
+            else
+            {
+                uint8_t bytes[] = {0xce, (uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value};
+                _out.write(bytes, sizeof(bytes));
+            }
+        }
+
+        void Float(float value)
+        {
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            uint8_t bytes[] = {0xca, (uint8_t)(bits >> 24), (uint8_t)(bits >> 16), (uint8_t)(bits >> 8), (uint8_t)bits};
+            _out.write(bytes, sizeof(bytes));
+        }
+
+        void Nil() { _out.write((uint8_t)0xc0); }
+    };
+}
@@ -0,0 +1,202 @@
+#pragma once
+#include <Arduino.h>
+#include <WiFi.h>
+#include <lwip/sockets.h>
+#include "Router.h"
+#include "Metrics.h"
+#include "../Sensors/SeqLock.h"
+
+//how many clients can be subscribed at once, each one holds a socket open
+#ifndef SIMPLEWEB_MAX_SUBSCRIBERS
+#define SIMPLEWEB_MAX_SUBSCRIBERS 4
+#endif
+
+//biggest event that can be published, including the id, event and data lines
+#ifndef SIMPLEWEB_EVENT_SIZE
+#define SIMPLEWEB_EVENT_SIZE 160
+#endif
+
+namespace SimpleWeb
+{
+    /*
+        Last published event, handed from the publisher to the web task through a SeqLock
+    */
+    struct Event
+    {
+        //0 until something has been published
+        uint32_t sequence;
+        uint16_t length;
+        char data[SIMPLEWEB_EVENT_SIZE];
+    };
+
+    /*
+        text/event-stream (Server-Sent Events) endpoint that keeps its subscribers connected and pushes
+        every published event to them, so they don't have to poll and reconnect.
+
+        Publish() can be called from any one task and never touches a socket. Check() runs on the web
+        task and sends the latest event to every subscriber without waiting, a subscriber whose socket
+        can't take the whole event straight away is dropped. A subscriber that falls behind only ever
+        misses events, it never holds anything up.
+    */
+    class EventStream : public IMetrics
+    {
+        public:
+        //comment line sent when nothing has been published for a while, finds dead subscribers
+        static const unsigned long KEEP_ALIVE_TIME = 15000;
+
+        private:
+        Sensors::SeqLock<Event> _event;
+        //only touched by the publisher
+        uint32_t _sequence;
+
+        //only touched by the web task
+        WiFiClient _subscribers[SIMPLEWEB_MAX_SUBSCRIBERS];
+        bool _active[SIMPLEWEB_MAX_SUBSCRIBERS];
+        uint32_t _sent;
+        unsigned long _lastSendTime;
+
+        Counter _eventsSent;
+        Counter _dropped;
+        Counter _rejected;
+
+        /*
+            returns false when the socket couldn't take all of it
+        */
+        static bool Send(WiFiClient& client, const char* data, size_t length)
+        {
+            ssize_t sent = send(client.fd(), data, length, MSG_DONTWAIT);
+            return sent == (ssize_t)length;
+        }
+
+        void Drop(uint8_t index)
+        {
+            _subscribers[index].stop();
+            _subscribers[index] = WiFiClient();
+            _active[index] = false;
+        }
+
+        void SendAll(const char* data, size_t length)
+        {
+            for(uint8_t i = 0; i < SIMPLEWEB_MAX_SUBSCRIBERS; i++)
+            {
+                if(!_active[i])
+                    continue;
+
+                if(!_subscribers[i].connected() || !Send(_subscribers[i], data, length))
+                {
+                    Serial.println("Event subscriber dropped");
+                    _dropped.Increment();
+                    Drop(i);
+                }
+            }
+        }
+
+        public:
+        EventStream() : _sequence(0), _sent(0), _lastSendTime(0)
+        {
+            for(uint8_t i = 0; i < SIMPLEWEB_MAX_SUBSCRIBERS; i++)
+                _active[i] = false;
+        }
+
+        void AddRoutes(Router& router, const char* path)
+        {
+            router.AddRoute<EventStream, &EventStream::GetStream>("GET", path, this);
+        }
+
+        /*
+            Publishes one event, data has to be a single line. Replaces the last one if Check() hasn't sent it yet.
+            Only call from one task.
+        */
+        void Publish(const char* name, const char* data)
+        {
+            Event event;
+            event.sequence = ++_sequence;
+            int length = snprintf(event.data, sizeof(event.data), "id: %u\nevent: %s\ndata: %s\n\n", (unsigned int)event.sequence, name, data);
+
+            if(length < 0 || length >= (int)sizeof(event.data))
+            {
+                Serial.printf("Event %s doesn't fit in %u bytes\n", name, (unsigned int)sizeof(event.data));
+                return;
+            }
+
+            event.length = length;
+            _event.Publish(event);
+        }
+
+        /*
+            Sends the latest event to the subscribers if it's new, call from the web task as often as possible
+        */
+        void Check()
+        {
+            Event event;
+            unsigned long now = millis();
+
+            if(!_event.TryRead(event))
+                return;
+
+            if(event.sequence != _sent)
+            {
+                _sent = event.sequence;
+                _lastSendTime = now;
+                SendAll(event.data, event.length);
+                _eventsSent.Increment();
+                return;
+            }
+
+            if(now - _lastSendTime >= KEEP_ALIVE_TIME)
+            {
+                _lastSendTime = now;
+                SendAll(":\n\n", 3);
+            }
+        }
+
+        /*
+            GET /stream subscribes the client, it gets the latest event straight away and every one after that
+        */
+        void GetStream(const Request& request, ResponseWriter& response)
+        {
+            uint8_t index = 0;
+
+            while(index < SIMPLEWEB_MAX_SUBSCRIBERS && _active[index])
+                index++;
+
+            if(index == SIMPLEWEB_MAX_SUBSCRIBERS)
+            {
+                _rejected.Increment();
+                response.Send(503);
+                return;
+            }
+
+            Event event;
+            _event.Read(event);
+
+            response.Begin(200, "text/event-stream");
+            response.Header("Cache-Control", "no-cache");
+            //how long the browser waits before reconnecting
+            response.print("retry: 5000\n\n");
+
+            if(event.sequence != 0)
+                response.write((const uint8_t*)event.data, event.length);
+
+            _subscribers[index] = response.Detach();
+            _active[index] = true;
+        }
+
+        void WriteMetrics(Print& out)
+        {
+            uint8_t subscribers = 0;
+
+            for(uint8_t i = 0; i < SIMPLEWEB_MAX_SUBSCRIBERS; i++)
+                subscribers += _active[i] ? 1 : 0;
+
+            out.println("# TYPE sse_subscribers gauge");
+            Printf(out, "sse_subscribers %u\n", subscribers);
+            out.println("# TYPE sse_events_total counter");
+            Printf(out, "sse_events_total %u\n", (unsigned int)_eventsSent.Value());
+            out.println("# TYPE sse_subscribers_dropped_total counter");
+            Printf(out, "sse_subscribers_dropped_total %u\n", (unsigned int)_dropped.Value());
+            out.println("# TYPE sse_subscribers_rejected_total counter");
+            Printf(out, "sse_subscribers_rejected_total %u\n", (unsigned int)_rejected.Value());
+        }
+    };
+}
@@ -2,6 +2,8 @@
 
 #include <WiFi.h>
 #include <vector>
+#include "Request.h"
+#include "ResponseWriter.h"
 using namespace std;
 
 namespace SimpleWeb
@@ -12,7 +14,7 @@ namespace SimpleWeb
         /*
             returns true when handled
         */
-        virtual bool Handler(WiFiClient& client, const String& header) = 0;
+        virtual bool Handler(const Request& request, ResponseWriter& response) = 0;
 
     };
 }
\ No newline at end of file
@@ -0,0 +1,151 @@
+#pragma once
+#include <Arduino.h>
+#include <WiFi.h>
+#include "ResponseCache.h"
+#include "ResponseWriter.h"
+#include "Metrics.h"
+
+//how many clients can be waiting at once, each one holds a socket open
+#ifndef SIMPLEWEB_MAX_LONG_POLLS
+#define SIMPLEWEB_MAX_LONG_POLLS 4
+#endif
+
+//longest a client can ask to wait, in milliseconds
+#ifndef SIMPLEWEB_MAX_WAIT
+#define SIMPLEWEB_MAX_WAIT 30000
+#endif
+
+namespace SimpleWeb
+{
+    /*
+        Clients waiting for a ResponseCache to have something newer than the tag they already have.
+        A handler defers the response with Wait() and Check() answers it from the web task as soon as
+        a newer response is published, or with a 304 when the wait runs out.
+        There can be a cache per encoding of the same response, each client is answered from the one it asked for.
+    */
+    class LongPoll : public IMetrics
+    {
+        private:
+        WiFiClient _clients[SIMPLEWEB_MAX_LONG_POLLS];
+        bool _active[SIMPLEWEB_MAX_LONG_POLLS];
+        uint32_t _since[SIMPLEWEB_MAX_LONG_POLLS];
+        //which of the caches passed to Check()
+        uint8_t _variants[SIMPLEWEB_MAX_LONG_POLLS];
+        unsigned long _deadlines[SIMPLEWEB_MAX_LONG_POLLS];
+
+        Counter _answered;
+        Counter _timeouts;
+        Counter _rejected;
+
+        void Finish(uint8_t index)
+        {
+            _clients[index].stop();
+            _clients[index] = WiFiClient();
+            _active[index] = false;
+        }
+
+        public:
+        LongPoll()
+        {
+            for(uint8_t i = 0; i < SIMPLEWEB_MAX_LONG_POLLS; i++)
+                _active[i] = false;
+        }
+
+        /*
+            Sends a header only 304 with the tag as the ETag
+        */
+        static void NotModified(WiFiClient& client, uint32_t tag)
+        {
+            char response[96];
+            int length = snprintf(response, sizeof(response),
+                "HTTP/1.1 304 Not Modified\r\n"
+                "ETag: \"%u\"\r\n"
+                "Connection: close\r\n"
+                "\r\n", (unsigned int)tag);
+
+            client.write((const uint8_t*)response, length);
+        }
+
+        /*
+            Takes the connection over until the response has moved on from since, for at most wait milliseconds.
+            returns false when there are too many waiting already, the response hasn't been touched
+        */
+        bool Wait(ResponseWriter& response, uint32_t since, unsigned long wait, uint8_t variant)
+        {
+            uint8_t index = 0;
+
+            while(index < SIMPLEWEB_MAX_LONG_POLLS && _active[index])
+                index++;
+
+            if(index == SIMPLEWEB_MAX_LONG_POLLS)
+            {
+                _rejected.Increment();
+                return false;
+            }
+
+            if(wait > SIMPLEWEB_MAX_WAIT)
+                wait = SIMPLEWEB_MAX_WAIT;
+
+            _clients[index] = response.Defer();
+            _active[index] = true;
+            _since[index] = since;
+            _variants[index] = variant;
+            _deadlines[index] = millis() + wait;
+            return true;
+        }
+
+        /*
+            Answers the clients that have something new or have waited long enough, call from the web task as often as possible
+        */
+        template<size_t Size, size_t Count>
+        void Check(ResponseCache<Size> (&caches)[Count])
+        {
+            unsigned long now = millis();
+
+            for(uint8_t i = 0; i < SIMPLEWEB_MAX_LONG_POLLS; i++)
+            {
+                if(!_active[i])
+                    continue;
+
+                ResponseCache<Size>& cache = caches[_variants[i] < Count ? _variants[i] : 0];
+                uint32_t tag = cache.Tag();
+
+                if(!_clients[i].connected())
+                {
+                    Finish(i);
+                    continue;
+                }
+
+                if(tag != _since[i])
+                {
+                    cache.Write(_clients[i]);
+                    _answered.Increment();
+                    Finish(i);
+                }
+                else if((long)(now - _deadlines[i]) >= 0)
+                {
+                    NotModified(_clients[i], tag);
+                    _timeouts.Increment();
+                    Finish(i);
+                }
+            }
+        }
+
+        void WriteMetrics(Print& out)
+        {
+            uint8_t waiting = 0;
+
+            for(uint8_t i = 0; i < SIMPLEWEB_MAX_LONG_POLLS; i++)
+                waiting += _active[i] ? 1 : 0;
+
+            out.println("# TYPE long_poll_waiting gauge");
+            Printf(out, "long_poll_waiting %u\n", waiting);
+            out.println("# TYPE long_poll_answered_total counter");
+            Printf(out, "long_poll_answered_total %u\n", (unsigned int)_answered.Value());
+            out.println("# TYPE long_poll_timeouts_total counter");
+            Printf(out, "long_poll_timeouts_total %u\n", (unsigned int)_timeouts.Value());
+            out.println("# TYPE long_poll_rejected_total counter");
+            Printf(out, "long_poll_rejected_total %u\n", (unsigned int)_rejected.Value());
+        }
+    };
+}
@@ -0,0 +1,166 @@
+#pragma once
+#include <Arduino.h>
+#include <atomic>
+#include <stdarg.h>
+
+//longest metric line Printf() formats on the stack
+#ifndef SIMPLEWEB_METRIC_LINE_SIZE
+#define SIMPLEWEB_METRIC_LINE_SIZE 160
+#endif
+
+namespace SimpleWeb
+{
+    /*
+        Count that only goes up, safe to bump from any task
+    */
+    class Counter
+    {
+        private:
+        std::atomic<uint32_t> _value;
+
+        public:
+        Counter() : _value(0)
+        {
+        }
+
+        void Increment(uint32_t amount = 1)
+        {
+            _value.fetch_add(amount, std::memory_order_relaxed);
+        }
+
+        uint32_t Value() const
+        {
+            return _value.load(std::memory_order_relaxed);
+        }
+    };
+
+    /*
+        Output that Printf() and ResponseWriter::printf() had to cut short rather than malloc a buffer
+        big enough for it
+    */
+    inline Counter& TruncatedOutput()
+    {
+        static Counter truncated;
+        return truncated;
+    }
+
+    /*
+        printf for the metrics. Print::printf mallocs whenever the output is 64 bytes or more, a histogram
+        bucket with labels always is, so this formats on the stack instead and the scrape doesn't touch
+        the heap. A line longer than SIMPLEWEB_METRIC_LINE_SIZE is left out, half a line would spoil the
+        whole scrape, and counted in TruncatedOutput().
+    */
+    inline size_t Printf(Print& out, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+    inline size_t Printf(Print& out, const char* format, ...)
+    {
+        char line[SIMPLEWEB_METRIC_LINE_SIZE];
+        va_list arguments;
+        va_start(arguments, format);
+        int length = vsnprintf(line, sizeof(line), format, arguments);
+        va_end(arguments);
+
+        if(length < 0)
+            return 0;
+
+        if(length >= (int)sizeof(line))
+        {
+            TruncatedOutput().Increment();
+            return 0;
+        }
+
+        return out.write((const uint8_t*)line, length);
+    }
+
+    /*
+        Fixed bucket histogram in static memory.
+        The bounds are upper limits in increasing order, anything above the last one goes in +Inf.
+    */
+    class Histogram
+    {
+        public:
+        static const uint8_t MAX_BUCKETS = 12;
+
+        private:
+        const uint32_t* _bounds;
+        uint8_t _boundCount;
+        //one more than the bounds for +Inf
+        std::atomic<uint32_t> _counts[MAX_BUCKETS + 1];
+        std::atomic<uint64_t> _sum;
+
+        public:
+        Histogram() : _bounds(nullptr), _boundCount(0), _sum(0)
+        {
+            for(uint8_t i = 0; i <= MAX_BUCKETS; i++)
+                _counts[i].store(0, std::memory_order_relaxed);
+        }
+
+        template<size_t Count>
+        Histogram(const uint32_t (&bounds)[Count]) : Histogram()
+        {
+            SetBounds(bounds);
+        }
+
+        template<size_t Count>
+        void SetBounds(const uint32_t (&bounds)[Count])
+        {
+            static_assert(Count <= MAX_BUCKETS, "too many histogram buckets");
+            _bounds = bounds;
+            _boundCount = Count;
+        }
+
+        void Observe(uint32_t value)
+        {
+            uint8_t bucket = 0;
+
+            while(bucket < _boundCount && value > _bounds[bucket])
+                bucket++;
+
+            _counts[bucket].fetch_add(1, std::memory_order_relaxed);
+            _sum.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        uint32_t Count() const
+        {
+            uint32_t count = 0;
+
+            for(uint8_t i = 0; i <= _boundCount; i++)
+                count += _counts[i].load(std::memory_order_relaxed);
+
+            return count;
+        }
+
+        /*
+            Writes the buckets, sum and count in the Prometheus text format.
+            labels is what goes between the braces, ex: route="GET /data", or an empty string
+        */
+        void Write(Print& out, const char* name, const char* labels) const
+        {
+            const char* separator = labels[0] == '\0' ? "" : ",";
+            uint32_t cumulative = 0;
+
+            for(uint8_t i = 0; i < _boundCount; i++)
+            {
+                cumulative += _counts[i].load(std::memory_order_relaxed);
+                Printf(out, "%s_bucket{%s%sle=\"%u\"} %u\n", name, labels, separator, (unsigned int)_bounds[i], (unsigned int)cumulative);
+            }
+
+            cumulative += _counts[_boundCount].load(std::memory_order_relaxed);
+            Printf(out, "%s_bucket{%s%sle=\"+Inf\"} %u\n", name, labels, separator, (unsigned int)cumulative);
+            Printf(out, "%s_sum{%s} %llu\n", name, labels, (unsigned long long)_sum.load(std::memory_order_relaxed));
+            Printf(out, "%s_count{%s} %u\n", name, labels, (unsigned int)cumulative);
+        }
+    };
+
+    /*
+        Anything that has metrics to add to GET /metrics
+    */
+    class IMetrics
+    {
+        public:
+        /*
+            Writes the metrics in the Prometheus text format
+        */
+        virtual void WriteMetrics(Print& out) = 0;
+    };
+}
@@ -0,0 +1,205 @@
+#pragma once
+#include <Arduino.h>
+#include <WiFi.h>
+#include "Router.h"
+#include "Metrics.h"
+#include "Encoding.h"
+
+//how many metric sources and tasks can be added
+#ifndef SIMPLEWEB_MAX_METRICS
+#define SIMPLEWEB_MAX_METRICS 4
+#endif
+
+namespace SimpleWeb
+{
+    /*
+        GET /metrics in the Prometheus text format.
+        Times every request through the router and adds heap, task stack and whatever the sources report.
+    */
+    class MetricsController
+    {
+        private:
+        Router& router;
+        //indexed by Route::id and the encoding asked for, the last route is for requests no route answered
+        Histogram requestTimes[SIMPLEWEB_MAX_ROUTES + 1][ENCODING_COUNT];
+        Counter responseBytes[SIMPLEWEB_MAX_ROUTES + 1][ENCODING_COUNT];
+#ifdef SIMPLEWEB_COUNT_ALLOCATIONS
+        //should stay at 0, anything a handler needs comes from the stack or the arena
+        Counter allocations[SIMPLEWEB_MAX_ROUTES + 1][ENCODING_COUNT];
+#endif
+        Counter rejected;
+        IMetrics* sources[SIMPLEWEB_MAX_METRICS];
+        uint8_t sourceCount = 0;
+        const char* taskNames[SIMPLEWEB_MAX_METRICS];
+        TaskHandle_t tasks[SIMPLEWEB_MAX_METRICS];
+        uint8_t taskCount = 0;
+
+        static void Observe(void* context, const RequestTrace& trace)
+        {
+            MetricsController* metrics = static_cast<MetricsController*>(context);
+            uint8_t index = trace.route == nullptr ? SIMPLEWEB_MAX_ROUTES : trace.route->id;
+
+            Encoding encoding = Encoder::Negotiate(*trace.request);
+
+            //JSON and MessagePack side by side, for the time and size each costs
+            metrics->requestTimes[index][encoding].Observe(trace.micros);
+            metrics->responseBytes[index][encoding].Increment(trace.bytesWritten);
+#ifdef SIMPLEWEB_COUNT_ALLOCATIONS
+            metrics->allocations[index][encoding].Increment(trace.allocations);
+#endif
+
+            if(trace.status != 0)
+                metrics->rejected.Increment();
+        }
+
+        public:
+        MetricsController(Router& router) : router(router)
+        {
+            //request latency buckets in microseconds
+            static const uint32_t requestBounds[] = {250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 1000000};
+
+            for(uint8_t i = 0; i <= SIMPLEWEB_MAX_ROUTES; i++)
+            {
+                for(uint8_t e = 0; e < ENCODING_COUNT; e++)
+                    requestTimes[i][e].SetBounds(requestBounds);
+            }
+
+            router.SetObserver(&MetricsController::Observe, this);
+        }
+
+        /*
+            Labels of the route at index in the table, the one past the end is requests no route answered.
+            returns the Route::id to index the metrics with
+        */
+        uint8_t RouteLabels(uint8_t index, Encoding encoding, char* labels, size_t size) const
+        {
+            if(index == router.RouteCount())
+            {
+                snprintf(labels, size, "route=\"other\",encoding=\"%s\"", Encoder::Name(encoding));
+                return SIMPLEWEB_MAX_ROUTES;
+            }
+
+            const Route& route = router.GetRoute(index);
+            snprintf(labels, size, "route=\"%s %s\",encoding=\"%s\"", route.method, route.path, Encoder::Name(encoding));
+            return route.id;
+        }
+
+        void AddRoutes(Router& router)
+        {
+            router.AddRoute<MetricsController, &MetricsController::GetMetrics>("GET", "/metrics", this);
+        }
+
+        void AddSource(IMetrics* source)
+        {
+            if(sourceCount < SIMPLEWEB_MAX_METRICS)
+                sources[sourceCount++] = source;
+        }
+
+        /*
+            Reports the task's stack high water mark
+        */
+        void AddTask(const char* name, TaskHandle_t task)
+        {
+            if(taskCount < SIMPLEWEB_MAX_METRICS)
+            {
+                taskNames[taskCount] = name;
+                tasks[taskCount++] = task;
+            }
+        }
+
+        /*
+            GET /metrics
+        */
+        void GetMetrics(const Request& request, ResponseWriter& response)
+        {
+            //bigger than one buffer, so this goes out chunked
+            response.Begin(200, "text/plain; version=0.0.4");
+
+            char labels[64];
+
+            response.println("# TYPE http_request_duration_microseconds histogram");
+
+            for(uint8_t i = 0; i <= router.RouteCount(); i++)
+            {
+                for(uint8_t e = 0; e < ENCODING_COUNT; e++)
+                {
+                    uint8_t id = RouteLabels(i, (Encoding)e, labels, sizeof(labels));
+
+                    //only the routes that have been asked for it
+                    if(e != EncodingJson && requestTimes[id][e].Count() == 0)
+                        continue;
+
+                    requestTimes[id][e].Write(response, "http_request_duration_microseconds", labels);
+                }
+            }
+
+            response.println("# TYPE http_response_bytes_total counter");
+
+            for(uint8_t i = 0; i <= router.RouteCount(); i++)
+            {
+                for(uint8_t e = 0; e < ENCODING_COUNT; e++)
+                {
+                    uint8_t id = RouteLabels(i, (Encoding)e, labels, sizeof(labels));
+
+                    if(e != EncodingJson && requestTimes[id][e].Count() == 0)
+                        continue;
+
+                    response.printf("http_response_bytes_total{%s} %u\n", labels, (unsigned int)responseBytes[id][e].Value());
+                }
+            }
+
+#ifdef SIMPLEWEB_COUNT_ALLOCATIONS
+            response.println("# TYPE http_request_allocations_total counter");
+
+            for(uint8_t i = 0; i <= router.RouteCount(); i++)
+            {
+                for(uint8_t e = 0; e < ENCODING_COUNT; e++)
+                {
+                    uint8_t id = RouteLabels(i, (Encoding)e, labels, sizeof(labels));
+
+                    if(e != EncodingJson && requestTimes[id][e].Count() == 0)
+                        continue;
+
+                    response.printf("http_request_allocations_total{%s} %u\n", labels, (unsigned int)allocations[id][e].Value());
+                }
+            }
+#endif
+
+            const Arena& arena = router.GetArena();
+            response.println("# TYPE http_arena_size_bytes gauge");
+            response.printf("http_arena_size_bytes %u\n", (unsigned int)Arena::Size());
+            //when this gets close to the size, raise SIMPLEWEB_ARENA_SIZE
+            response.println("# TYPE http_arena_used_max_bytes gauge");
+            response.printf("http_arena_used_max_bytes %u\n", (unsigned int)arena.Peak());
+            response.println("# TYPE http_arena_exhausted_total counter");
+            response.printf("http_arena_exhausted_total %u\n", (unsigned int)arena.Failures());
+
+            response.println("# TYPE http_requests_rejected_total counter");
+            response.printf("http_requests_rejected_total %u\n", (unsigned int)rejected.Value());
+
+            response.println("# TYPE http_output_truncated_total counter");
+            response.printf("http_output_truncated_total %u\n", (unsigned int)TruncatedOutput().Value());
+
+            response.println("# TYPE heap_free_bytes gauge");
+            response.printf("heap_free_bytes %u\n", (unsigned int)ESP.getFreeHeap());
+            response.println("# TYPE heap_free_min_bytes gauge");
+            response.printf("heap_free_min_bytes %u\n", (unsigned int)ESP.getMinFreeHeap());
+            //when this falls well below the free heap, the heap is fragmented
+            response.println("# TYPE heap_largest_free_block_bytes gauge");
+            response.printf("heap_largest_free_block_bytes %u\n", (unsigned int)ESP.getMaxAllocHeap());
+
+            response.println("# TYPE task_stack_free_min_bytes gauge");
+
+            for(uint8_t i = 0; i < taskCount; i++)
+                response.printf("task_stack_free_min_bytes{task=\"%s\"} %u\n", taskNames[i], (unsigned int)uxTaskGetStackHighWaterMark(tasks[i]));
+
+            response.println("# TYPE uptime_seconds counter");
+            response.printf("uptime_seconds %lu\n", millis() / 1000);
+
+            for(uint8_t i = 0; i < sourceCount; i++)
+                sources[i]->WriteMetrics(response);
+
+            response.End();
+        }
+    };
+}
@@ -0,0 +1,404 @@
+#pragma once
+#include <Arduino.h>
+
+//largest request (request line, headers and body) that will be accepted
+#ifndef SIMPLEWEB_MAX_REQUEST_SIZE
+#define SIMPLEWEB_MAX_REQUEST_SIZE 1024
+#endif
+
+//largest body that will be accepted, the rest of the buffer is left for the request line and headers
+#ifndef SIMPLEWEB_MAX_BODY_SIZE
+#define SIMPLEWEB_MAX_BODY_SIZE 512
+#endif
+
+//most headers that will be kept for a single request
+#ifndef SIMPLEWEB_MAX_HEADERS
+#define SIMPLEWEB_MAX_HEADERS 16
+#endif
+
+namespace SimpleWeb
+{
+    class Arena;
+
+    struct Header
+    {
+        const char* name;
+        const char* value;
+    };
+
+    /*
+        Parsed view of a request.
+        Everything points into the parser's buffer and is only valid until the parser is reset.
+    */
+    class Request
+    {
+        public:
+        const char* method;
+        const char* path;
+        //everything after the '?' or an empty string
+        const char* query;
+        Header headers[SIMPLEWEB_MAX_HEADERS];
+        uint8_t headerCount;
+        const char* body;
+        size_t bodyLength;
+        //scratch memory for the handler, given back once the response has been sent, see Arena
+        Arena* arena;
+
+        /*
+            returns true when the method and path match exactly
+        */
+        bool Is(const char* method, const char* path) const
+        {
+            return strcmp(this->method, method) == 0 && strcmp(this->path, path) == 0;
+        }
+
+        /*
+            Finds a header by name ignoring case.
+            returns nullptr when the header wasn't sent
+        */
+        const char* GetHeader(const char* name) const
+        {
+            for(uint8_t i = 0; i < headerCount; i++)
+            {
+                if(strcasecmp(headers[i].name, name) == 0)
+                    return headers[i].value;
+            }
+
+            return nullptr;
+        }
+
+        /*
+            Whether the Accept header lists the media type, parameters like ;q= are ignored.
+            returns false when there's no Accept header
+        */
+        bool Accepts(const char* type) const
+        {
+            const char* accept = GetHeader("Accept");
+
+            if(accept == nullptr)
+                return false;
+
+            size_t length = strlen(type);
+
+            while(*accept != '\0')
+            {
+                while(*accept == ' ' || *accept == ',')
+                    accept++;
+
+                const char* end = accept;
+
+                while(*end != '\0' && *end != ',' && *end != ';' && *end != ' ')
+                    end++;
+
+                if((size_t)(end - accept) == length && strncasecmp(accept, type, length) == 0)
+                    return true;
+
+                accept = strchr(end, ',');
+
+                if(accept == nullptr)
+                    return false;
+            }
+
+            return false;
+        }
+
+        /*
+            Copies the value of a query string parameter into value, ex: sensor from ?sensor=PH&step=60
+            Values aren't percent decoded.
+            returns false when the parameter wasn't sent or doesn't fit
+        */
+        bool GetQuery(const char* name, char* value, size_t size) const
+        {
+            size_t nameLength = strlen(name);
+            const char* parameter = query;
+
+            while(*parameter != '\0')
+            {
+                const char* end = strchr(parameter, '&');
+
+                if(end == nullptr)
+                    end = parameter + strlen(parameter);
+
+                if(strncmp(parameter, name, nameLength) == 0 && parameter[nameLength] == '=')
+                {
+                    const char* start = parameter + nameLength + 1;
+                    size_t length = end - start;
+
+                    if(length >= size)
+                        return false;
+
+                    memcpy(value, start, length);
+                    value[length] = '\0';
+                    return true;
+                }
+
+                parameter = *end == '&' ? end + 1 : end;
+            }
+
+            return false;
+        }
+    };
+
+    /*
+        Incremental parser for the request line, headers and body.
+        Bytes are read straight into a fixed buffer and the lines are terminated in place,
+        so nothing is allocated while parsing.
+    */
+    class RequestParser
+    {
+        public:
+        enum State
+        {
+            RequestLine,
+            Headers,
+            Body,
+            Complete,
+            Failed
+        };
+
+        private:
+        //one extra byte so the body can always be terminated
+        char _buffer[SIMPLEWEB_MAX_REQUEST_SIZE + 1];
+        size_t _length;
+        //start of the line that hasn't been parsed yet
+        size_t _lineStart;
+        size_t _bodyStart;
+        size_t _contentLength;
+        State _state;
+        int _status;
+        Request _request;
+
+        State Fail(int status)
+        {
+            _status = status;
+            _state = Failed;
+            return _state;
+        }
+
+        static char* TrimStart(char* text)
+        {
+            while(*text == ' ' || *text == '\t')
+                text++;
+
+            return text;
+        }
+
+        static void TrimEnd(char* start, char* end)
+        {
+            while(end > start && (end[-1] == ' ' || end[-1] == '\t'))
+                end--;
+
+            *end = '\0';
+        }
+
+        /*
+            METHOD SP target SP HTTP/1.x
+        */
+        bool ParseRequestLine(char* line)
+        {
+            char* target = strchr(line, ' ');
+
+            if(target == nullptr || target == line)
+                return false;
+
+            *target++ = '\0';
+            char* version = strchr(target, ' ');
+
+            if(version == nullptr || *target != '/')
+                return false;
+
+            *version++ = '\0';
+
+            if(strncmp(version, "HTTP/1.", 7) != 0)
+                return false;
+
+            for(char* c = line; *c != '\0'; c++)
+            {
+                if(*c < 'A' || *c > 'Z')
+                    return false;
+            }
+
+            char* query = strchr(target, '?');
+
+            if(query == nullptr)
+            {
+                _request.query = "";
+            }
+            else
+            {
+                *query++ = '\0';
+                _request.query = query;
+            }
+
+            _request.method = line;
+            _request.path = target;
+            return true;
+        }
+
+        /*
+            returns the status to fail with or 0 when the header is ok
+        */
+        int ParseHeader(char* line)
+        {
+            char* separator = strchr(line, ':');
+
+            if(separator == nullptr || separator == line)
+                return 400;
+
+            if(_request.headerCount == SIMPLEWEB_MAX_HEADERS)
+                return 431;
+
+            TrimEnd(line, separator);
+            char* value = TrimStart(separator + 1);
+            TrimEnd(value, value + strlen(value));
+
+            if(strcasecmp(line, "Content-Length") == 0)
+            {
+                char* end;
+                unsigned long length = strtoul(value, &end, 10);
+
+                if(end == value || *end != '\0')
+                    return 400;
+
+                _contentLength = length;
+            }
+
+            _request.headers[_request.headerCount].name = line;
+            _request.headers[_request.headerCount].value = value;
+            _request.headerCount++;
+            return 0;
+        }
+
+        State CheckBody()
+        {
+            if(_length - _bodyStart >= _contentLength)
+            {
+                _buffer[_bodyStart + _contentLength] = '\0';
+                _request.body = _buffer + _bodyStart;
+                _request.bodyLength = _contentLength;
+                _state = Complete;
+            }
+
+            return _state;
+        }
+
+        public:
+        RequestParser()
+        {
+            _request.arena = nullptr;
+            Reset();
+        }
+
+        /*
+            Arena handed to the handlers with every request, it's kept across Reset()
+        */
+        void SetArena(Arena* arena)
+        {
+            _request.arena = arena;
+        }
+
+        void Reset()
+        {
+            _length = 0;
+            _lineStart = 0;
+            _bodyStart = 0;
+            _contentLength = 0;
+            _state = RequestLine;
+            _status = 0;
+            _request.method = "";
+            _request.path = "";
+            _request.query = "";
+            _request.headerCount = 0;
+            _request.body = "";
+            _request.bodyLength = 0;
+        }
+
+        /*
+            Where the next bytes from the client should be read to
+        */
+        char* WritePointer()
+        {
+            return _buffer + _length;
+        }
+
+        /*
+            How many bytes can still be read before the request is too large
+        */
+        size_t Space() const
+        {
+            return SIMPLEWEB_MAX_REQUEST_SIZE - _length;
+        }
+
+        /*
+            Parses the bytes that were just read to WritePointer().
+            returns the state after consuming them
+        */
+        State Feed(size_t count)
+        {
+            _length += count;
+
+            while(_state == RequestLine || _state == Headers)
+            {
+                char* start = _buffer + _lineStart;
+                char* newLine = (char*)memchr(start, '\n', _length - _lineStart);
+
+                if(newLine == nullptr)
+                {
+                    if(_length == SIMPLEWEB_MAX_REQUEST_SIZE)
+                        return Fail(431);
+
+                    return _state;
+                }
+
+                _lineStart = newLine - _buffer + 1;
+
+                if(newLine > start && newLine[-1] == '\r')
+                    newLine--;
+
+                *newLine = '\0';
+
+                if(_state == RequestLine)
+                {
+                    //ignore empty lines in front of the request
+                    if(*start == '\0')
+                        continue;
+
+                    if(!ParseRequestLine(start))
+                        return Fail(400);
+
+                    _state = Headers;
+                }
+                else if(*start == '\0')
+                {
+                    _bodyStart = _lineStart;
+
+                    if(_contentLength > SIMPLEWEB_MAX_BODY_SIZE || _contentLength > SIMPLEWEB_MAX_REQUEST_SIZE - _bodyStart)
+                        return Fail(413);
+
+                    _state = Body;
+                }
+                else
+                {
+                    int status = ParseHeader(start);
+
+                    if(status != 0)
+                        return Fail(status);
+                }
+            }
+
+            if(_state == Body)
+                return CheckBody();
+
+            return _state;
+        }
+
+        State GetState() const { return _state; }
+
+        /*
+            Status code to respond with when parsing failed
+        */
+        int GetStatus() const { return _status; }
+
+        const Request& GetRequest() const { return _request; }
+    };
+}
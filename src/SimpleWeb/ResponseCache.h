@@ -0,0 +1,110 @@
+#pragma once
+#include <WiFi.h>
+#include <atomic>
+#include "ResponseWriter.h"
+
+namespace SimpleWeb
+{
+    /*
+        A complete HTTP response (status line, headers and body) rendered ahead of time by one
+        writer and sent as is by the web task.
+        There are two buffers, the writer renders into the one that isn't being served and then
+        swaps them, so the web task never waits and never sees a half rendered response.
+        Each response carries a tag that goes up with every new one, ex: the cycle it was rendered from, for ETags.
+    */
+    template<size_t Size>
+    class ResponseCache
+    {
+        private:
+        char _buffers[2][Size];
+        size_t _lengths[2];
+        uint32_t _tags[2];
+        //buffer that is being served
+        std::atomic<uint8_t> _current;
+        //how many clients are being written from each buffer
+        std::atomic<uint8_t> _readers[2];
+
+        static size_t Send(ResponseWriter& response, const char* data, size_t length)
+        {
+            return response.SendRaw(data, length);
+        }
+
+        static size_t Send(WiFiClient& client, const char* data, size_t length)
+        {
+            return client.write((const uint8_t*)data, length);
+        }
+
+        public:
+        ResponseCache() : _current(0)
+        {
+            _lengths[0] = 0;
+            _lengths[1] = 0;
+            _tags[0] = 0;
+            _tags[1] = 0;
+            _readers[0].store(0);
+            _readers[1].store(0);
+        }
+
+        /*
+            Buffer to render the next response into. Only call from the writer.
+            returns nullptr when the spare buffer is still being sent, try again later
+        */
+        char* BeginRender()
+        {
+            uint8_t spare = 1 - _current.load();
+
+            if(_readers[spare].load() != 0)
+                return nullptr;
+
+            return _buffers[spare];
+        }
+
+        /*
+            Swaps in the buffer returned by BeginRender(). Only call from the writer.
+        */
+        void Publish(size_t length, uint32_t tag)
+        {
+            uint8_t spare = 1 - _current.load();
+            _lengths[spare] = length;
+            _tags[spare] = tag;
+            _current.store(spare);
+        }
+
+        /*
+            Sends the current response in one write, to a ResponseWriter or straight to a client.
+            returns the number of bytes written, 0 when nothing has been rendered yet
+        */
+        template<class Output>
+        size_t Write(Output& out)
+        {
+            uint8_t current;
+
+            //mark the buffer as being read, then make sure it wasn't swapped out in the meantime
+            while(true)
+            {
+                current = _current.load();
+                _readers[current]++;
+
+                if(_current.load() == current)
+                    break;
+
+                _readers[current]--;
+            }
+
+            size_t written = 0;
+
+            if(_lengths[current] > 0)
+                written = Send(out, _buffers[current], _lengths[current]);
+
+            _readers[current]--;
+            return written;
+        }
+
+        /*
+            Tag of the response being served, 0 when nothing has been rendered yet
+        */
+        uint32_t Tag() const { return _tags[_current.load()]; }
+
+        static size_t Capacity() { return Size; }
+    };
+}
@@ -0,0 +1,340 @@
+#pragma once
+#include <Arduino.h>
+#include <stdarg.h>
+#include <WiFi.h>
+#include "Metrics.h"
+
+//room for the status line and headers
+#ifndef SIMPLEWEB_RESPONSE_HEADER_SIZE
+#define SIMPLEWEB_RESPONSE_HEADER_SIZE 256
+#endif
+
+//bodies up to this size go out in a single write with a Content-Length, bigger ones are chunked
+#ifndef SIMPLEWEB_RESPONSE_BODY_SIZE
+#define SIMPLEWEB_RESPONSE_BODY_SIZE 1024
+#endif
+
+namespace SimpleWeb
+{
+    /*
+        Buffers a whole response so it goes to the client in as few writes as possible.
+        Begin() starts the headers, the body is written through Print (so serializeJson and printf work)
+        and End() sends it all at once with the right Content-Length.
+        When the body outgrows the buffer it switches to chunked transfer encoding and sends one chunk
+        per buffer full.
+    */
+    class ResponseWriter : public Print
+    {
+        private:
+        //chunk sizes are written in front of the body, "%X\r\n"
+        static const size_t CHUNK_PREFIX_SIZE = 10;
+        //"\r\n" after a chunk and "0\r\n\r\n" after the last one
+        static const size_t CHUNK_SUFFIX_SIZE = 7;
+
+        WiFiClient* _client;
+        //[headers | room for a chunk size][body][chunk suffix]
+        char _buffer[SIMPLEWEB_RESPONSE_HEADER_SIZE + CHUNK_PREFIX_SIZE + SIMPLEWEB_RESPONSE_BODY_SIZE + CHUNK_SUFFIX_SIZE];
+        size_t _headerLength;
+        size_t _bodyLength;
+        bool _started;
+        bool _headersSent;
+        //the handler took the connection over, the router leaves it open
+        bool _detached;
+        size_t _bytesWritten;
+
+        char* Body()
+        {
+            return _buffer + SIMPLEWEB_RESPONSE_HEADER_SIZE + CHUNK_PREFIX_SIZE;
+        }
+
+        void AppendHeader(const char* format, ...) __attribute__((format(printf, 2, 3)))
+        {
+            va_list arguments;
+            va_start(arguments, format);
+            int length = vsnprintf(_buffer + _headerLength, SIMPLEWEB_RESPONSE_HEADER_SIZE - _headerLength, format, arguments);
+            va_end(arguments);
+
+            if(length < 0 || _headerLength + length >= SIMPLEWEB_RESPONSE_HEADER_SIZE)
+            {
+                Serial.printf("Response header dropped, %s\n", format);
+                _buffer[_headerLength] = '\0';
+                return;
+            }
+
+            _headerLength += length;
+        }
+
+        /*
+            Formats after what's in the body, returns the length it needed even when it didn't all fit.
+            The terminator can land in the first byte after the body, that's room for the chunk suffix.
+        */
+        int Format(const char* format, va_list arguments)
+        {
+            return vsnprintf(Body() + _bodyLength, SIMPLEWEB_RESPONSE_BODY_SIZE - _bodyLength + 1, format, arguments);
+        }
+
+        size_t Transmit(const char* data, size_t length)
+        {
+            if(_client == nullptr)
+                return 0;
+
+            size_t written = _client->write((const uint8_t*)data, length);
+            _bytesWritten += written;
+            return written;
+        }
+
+        /*
+            Sends the buffered body as a chunk, with the headers in front of it the first time
+        */
+        void FlushChunk(bool last)
+        {
+            char* body = Body();
+            char* start = body;
+            char* end = body + _bodyLength;
+
+            if(_bodyLength > 0)
+            {
+                char prefix[CHUNK_PREFIX_SIZE];
+                int prefixLength = snprintf(prefix, sizeof(prefix), "%X\r\n", (unsigned int)_bodyLength);
+                start -= prefixLength;
+                memcpy(start, prefix, prefixLength);
+                memcpy(end, "\r\n", 2);
+                end += 2;
+            }
+
+            if(last)
+            {
+                memcpy(end, "0\r\n\r\n", 5);
+                end += 5;
+            }
+
+            if(!_headersSent)
+            {
+                AppendHeader("Transfer-Encoding: chunked\r\n\r\n");
+                start -= _headerLength;
+                memmove(start, _buffer, _headerLength);
+                _headersSent = true;
+            }
+
+            Transmit(start, end - start);
+            _bodyLength = 0;
+        }
+
+        /*
+            Ends the headers and sends them with the body in one write
+        */
+        void SendBuffered(bool withLength)
+        {
+            if(withLength)
+                AppendHeader("Content-Length: %u\r\n\r\n", (unsigned int)_bodyLength);
+            else
+                AppendHeader("\r\n");
+
+            //move the headers right up against the body so it all goes out in one write
+            char* start = Body() - _headerLength;
+            memmove(start, _buffer, _headerLength);
+            Transmit(start, _headerLength + _bodyLength);
+            _headersSent = true;
+            _bodyLength = 0;
+        }
+
+        public:
+        ResponseWriter() :
+            _client(nullptr),
+            _headerLength(0),
+            _bodyLength(0),
+            _started(false),
+            _headersSent(false),
+            _detached(false),
+            _bytesWritten(0)
+        {
+        }
+
+        /*
+            Gets the writer ready for the next response
+        */
+        void Reset(WiFiClient& client)
+        {
+            _client = &client;
+            _headerLength = 0;
+            _bodyLength = 0;
+            _started = false;
+            _headersSent = false;
+            _detached = false;
+            _bytesWritten = 0;
+        }
+
+        /*
+            Starts the response with the status line and content type, add any other headers before writing the body
+        */
+        void Begin(int status, const char* contentType)
+        {
+            _headerLength = 0;
+            _bodyLength = 0;
+            _started = true;
+            _headersSent = false;
+            AppendHeader("HTTP/1.1 %i %s\r\n", status, StatusText(status));
+
+            if(contentType != nullptr)
+                AppendHeader("Content-Type: %s\r\n", contentType);
+
+            AppendHeader("Connection: close\r\n");
+        }
+
+        void Header(const char* name, const char* value)
+        {
+            AppendHeader("%s: %s\r\n", name, value);
+        }
+
+        size_t write(uint8_t c)
+        {
+            return write(&c, 1);
+        }
+
+        size_t write(const uint8_t* data, size_t size)
+        {
+            size_t remaining = size;
+
+            while(remaining > 0)
+            {
+                if(_bodyLength == SIMPLEWEB_RESPONSE_BODY_SIZE)
+                    FlushChunk(false);
+
+                size_t space = SIMPLEWEB_RESPONSE_BODY_SIZE - _bodyLength;
+                size_t count = remaining < space ? remaining : space;
+                memcpy(Body() + _bodyLength, data, count);
+                _bodyLength += count;
+                data += count;
+                remaining -= count;
+            }
+
+            return size;
+        }
+
+        using Print::write;
+
+        /*
+            Formats straight into the body, Print::printf mallocs for anything 64 bytes or longer.
+            When it doesn't fit in what's left the buffer goes out as a chunk and it's formatted again.
+            Output bigger than the whole buffer is cut short at SIMPLEWEB_RESPONSE_BODY_SIZE and counted in
+            TruncatedOutput(), none of the handlers write one.
+        */
+        size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)))
+        {
+            va_list arguments;
+            va_start(arguments, format);
+            int length = Format(format, arguments);
+            va_end(arguments);
+
+            if(length < 0)
+                return 0;
+
+            if((size_t)length > SIMPLEWEB_RESPONSE_BODY_SIZE - _bodyLength && _bodyLength > 0)
+            {
+                FlushChunk(false);
+                va_start(arguments, format);
+                length = Format(format, arguments);
+                va_end(arguments);
+            }
+
+            if((size_t)length > SIMPLEWEB_RESPONSE_BODY_SIZE - _bodyLength)
+            {
+                TruncatedOutput().Increment();
+                length = SIMPLEWEB_RESPONSE_BODY_SIZE - _bodyLength;
+            }
+
+            _bodyLength += length;
+            return length;
+        }
+
+        /*
+            Sends whatever is still buffered. Called by the router if the handler doesn't.
+        */
+        void End()
+        {
+            if(!_started)
+                return;
+
+            _started = false;
+
+            if(_headersSent)
+            {
+                FlushChunk(true);
+                return;
+            }
+
+            SendBuffered(true);
+        }
+
+        /*
+            Sends the headers and what's been written so far with no length, and hands the connection
+            over to the caller for a response that never ends, ex: text/event-stream.
+            The router won't close the client, whoever keeps a copy of it does.
+            Call it before the body outgrows the buffer.
+        */
+        WiFiClient& Detach()
+        {
+            if(_started && !_headersSent)
+                SendBuffered(false);
+
+            _started = false;
+            _detached = true;
+            return *_client;
+        }
+
+        /*
+            Hands the connection over to the caller without sending anything, for a response that's
+            sent later from outside the handler, ex: a long poll.
+            The router won't close the client, whoever keeps a copy of it does.
+        */
+        WiFiClient& Defer()
+        {
+            _started = false;
+            _detached = true;
+            return *_client;
+        }
+
+        /*
+            Response with no body, used for errors
+        */
+        void Send(int status)
+        {
+            Begin(status, nullptr);
+            End();
+        }
+
+        /*
+            Sends an already complete response (status line, headers and body) as is
+        */
+        size_t SendRaw(const char* response, size_t length)
+        {
+            _started = false;
+            return Transmit(response, length);
+        }
+
+        bool IsStarted() const { return _started; }
+
+        bool IsDetached() const { return _detached; }
+
+        size_t BytesWritten() const { return _bytesWritten; }
+
+        WiFiClient& Client() { return *_client; }
+
+        static const char* StatusText(int status)
+        {
+            switch (status)
+            {
+                case 200: return "OK";
+                case 202: return "Accepted";
+                case 304: return "Not Modified";
+                case 400: return "Bad Request";
+                case 404: return "Not Found";
+                case 408: return "Request Timeout";
+                case 413: return "Payload Too Large";
+                case 431: return "Request Header Fields Too Large";
+                case 503: return "Service Unavailable";
+                default: return "Error";
+            }
+        }
+    };
+}
@@ -1,87 +1,277 @@
 #pragma once
 #include <vector>
 #include <WiFi.h>
+#include <lwip/sockets.h>
 #include "IController.h"
 #include "Router.h"
 using namespace std;
 
 namespace SimpleWeb
 {
-    /*Checks for new clients and handles them*/
+    /*
+        Accepts new clients and services the ones in flight.
+        Never waits on a client, call it as often as possible.
+    */
     void Router::Check()
     {
-        WiFiClient client = _server.available();   // Listen for incoming clients  
-
-        if (client) 
-        { 
-            String header;
-            bool isHandled = false;                 
-            currentTime = millis();
-            previousTime = currentTime;
+        unsigned long now = millis();
+
+        Accept(now);
+
+        for (uint8_t i = 0; i < SIMPLEWEB_MAX_CONNECTIONS; i++)
+            Service(_connections[(_nextConnection + i) % SIMPLEWEB_MAX_CONNECTIONS], now);
+
+        _nextConnection = (_nextConnection + 1) % SIMPLEWEB_MAX_CONNECTIONS;
+    }
+
+    /*
+        Moves waiting clients into free connection slots.
+        When the table is full they stay in the server's backlog until a slot frees up.
+    */
+    void Router::Accept(unsigned long now)
+    {
+        for (uint8_t i = 0; i < SIMPLEWEB_MAX_CONNECTIONS; i++)
+        {
+            Connection& connection = _connections[i];
+
+            if (connection.active)
+                continue;
+
+            WiFiClient client = _server.available();   // Listen for incoming clients  
+
+            if (!client)
+                return;
+
             Serial.println("New Client.");          // print a message out in the serial port
-            String currentLine = "";                // make a String to hold incoming data from the client
-
-            Serial.printf("Connected=%i\n", client.connected());
-
-            while (client.connected() && currentTime - previousTime <= timeoutTime) // 
-            {  
-                // loop while the client's connected
-                currentTime = millis();
-                // if there's bytes to read from the client,
-
-                //Serial.printf("available=%i\n", client.available());
-
-                if (client.available()) 
-                {             
-                    char c = client.read();             // read a byte, then
-                    //Serial.println(c);                    // print it out the serial monitor
-                    header += c;
-                    if (c == '\n') 
-                    {                                  
-                        //Serial.printf("header=%s", header.c_str());
-                              // if the byte is a newline character
-                        // if the current line is blank, you got two newline characters in a row.
-                        // that's the end of the client HTTP request, so send a response:
-                        if (currentLine.length() == 0) 
-                        {                       
-                            Serial.printf("Checking controllers Header=%s\n", header.c_str());
-
-                            for(int i=0; i< _controllers.size(); i++)
-                            {   
-                                if(_controllers[i]->Handler(client, header.c_str()))
-                                {
-                                    isHandled = true;
-                                    break;
-                                }
-                            }
-                            
-                            if(!isHandled)
-                            {
-                                Serial.printf("unknown header\n");
-                            }
-                            // Break out of the while loop
-                            break;
-                        } 
-                        else 
-                        { 
-                            // if you got a newline, then clear currentLine
-                            currentLine = "";
-                        }
-                    } 
-                    else if (c != '\r') 
-                    {  
-                        // if you got anything else but a carriage return character,
-                        currentLine += c;      // add it to the end of the currentLine                
-                    }
-                }            
+            connection.active = true;
+            connection.client = client;
+            connection.parser.Reset();
+            connection.deadline = now + timeoutTime;
+            connection.acceptedMicros = micros();
+            connection.acceptedAllocations = Allocations::Count();
+            connection.bytesRead = 0;
+        }
+    }
+
+    /*
+        Reads whatever the client has sent so far and answers once the request is complete
+    */
+    void Router::Service(Connection& connection, unsigned long now)
+    {
+        if (!connection.active)
+            return;
+
+        WiFiClient& client = connection.client;
+        RequestParser& parser = connection.parser;
+
+        // if there's bytes to read from the client, read as many as will fit in one go.
+        // straight from the socket, WiFiClient mallocs a receive buffer the first time it's read
+        if (parser.Space() > 0)
+        {
+            ssize_t read = recv(client.fd(), parser.WritePointer(), parser.Space(), MSG_DONTWAIT);
+
+            if (read > 0)
+            {
+                connection.bytesRead += read;
+                parser.Feed(read);
             }
+        }
+
+        _response.Reset(client);
+
+        switch (parser.GetState())
+        {
+            case RequestParser::Complete:
+                Trace(connection, Dispatch(parser.GetRequest()), 0);
+                break;
+            case RequestParser::Failed:
+                Serial.printf("Bad request %i\n", parser.GetStatus());
+                _response.Send(parser.GetStatus());
+                Trace(connection, nullptr, parser.GetStatus());
+                break;
+            default:
+                if (!client.connected())
+                    break;
 
-            // Clear the header variable
-            header = "";
-            // Close the connection
-            client.stop();
-            Serial.println("Client disconnected.");
-            Serial.println("");  
+                //still waiting on the rest of the request
+                if ((long)(now - connection.deadline) < 0)
+                    return;
+
+                _response.Send(408);
+                Trace(connection, nullptr, 408);
+                break;
         }
+
+        //nothing the handler took from the arena outlives the response
+        _arena.Reset();
+
+        //the handler kept a copy of the client, let go of ours without closing the socket
+        if(_response.IsDetached())
+        {
+            connection.client = WiFiClient();
+            connection.active = false;
+            return;
+        }
+
+        Close(connection);
+    }
+
+    void Router::Close(Connection& connection)
+    {
+        connection.client.stop();
+        connection.client = WiFiClient();
+        connection.active = false;
+        Serial.println("Client disconnected.");
+    }
+
+    /*
+        returns the route that answered or nullptr
+    */
+    const Route* Router::Dispatch(const Request& request)
+    {
+        Serial.printf("Checking routes %s %s\n", request.method, request.path);
+
+        const Route* route = FindRoute(request.method, request.path);
+
+        if(route != nullptr)
+        {
+            route->handler(route->context, request, _response);
+            //sends whatever the handler left in the buffer
+            _response.End();
+            return route;
+        }
+
+        for(size_t i=0; i< _controllers.size(); i++)
+        {   
+            if(_controllers[i]->Handler(request, _response))
+            {
+                _response.End();
+                return nullptr;
+            }
+        }
+
+        Serial.printf("unknown request\n");
+        _response.Send(404);
+        return nullptr;
+    }
+
+    void Router::Trace(Connection& connection, const Route* route, int status)
+    {
+        RequestTrace trace;
+        trace.route = route;
+        trace.request = &connection.parser.GetRequest();
+        trace.status = status;
+        trace.micros = micros() - connection.acceptedMicros;
+        trace.bytesRead = connection.bytesRead;
+        trace.bytesWritten = _response.BytesWritten();
+        trace.allocations = Allocations::Count() - connection.acceptedAllocations;
+        trace.arenaBytes = _arena.Used();
+
+#ifdef SIMPLEWEB_COUNT_ALLOCATIONS
+        Serial.printf("%s %s took %u us, %u allocations, %u arena bytes\n", trace.request->method, trace.request->path, (unsigned int)trace.micros, (unsigned int)trace.allocations, (unsigned int)trace.arenaBytes);
+#endif
+
+        if(_observer != nullptr)
+            _observer(_observerContext, trace);
+    }
+
+    bool Router::AddRoute(const char* method, const char* path, RouteHandler handler, void* context)
+    {
+        size_t length = strlen(path);
+
+        if(_routeCount == SIMPLEWEB_MAX_ROUTES || FindRoute(method, path, length, false) != nullptr)
+        {
+            Serial.printf("Can't add route %s %s\n", method, path);
+            return false;
+        }
+
+        //the '*' is hashed the same way a wildcard lookup hashes it
+        uint32_t key = RouteKey(method, path, length, false);
+        uint8_t i = _routeCount;
+
+        //insertion sort, routes are only added at start up
+        for(; i > 0 && _routes[i - 1].key > key; i--)
+            _routes[i] = _routes[i - 1];
+
+        _routes[i].key = key;
+        _routes[i].method = method;
+        _routes[i].path = path;
+        _routes[i].handler = handler;
+        _routes[i].context = context;
+        _routes[i].id = _routeCount;
+        _routeCount++;
+        return true;
+    }
+
+    const Route* Router::FindRoute(const char* method, const char* path) const
+    {
+        const Route* route = FindRoute(method, path, strlen(path), false);
+
+        if(route != nullptr)
+            return route;
+
+        //try the route that takes any last segment, ex: /CMD/12 matches /CMD/*
+        const char* lastSegment = strrchr(path, '/');
+
+        if(lastSegment == nullptr)
+            return nullptr;
+
+        return FindRoute(method, path, lastSegment - path + 1, true);
+    }
+
+    /*
+        Binary search for the first `length` characters of the path, followed by a '*' when it's a wildcard
+    */
+    const Route* Router::FindRoute(const char* method, const char* path, size_t length, bool wildcard) const
+    {
+        uint32_t key = RouteKey(method, path, length, wildcard);
+        uint8_t low = 0;
+        uint8_t high = _routeCount;
+
+        //first route with a key that isn't less than the one we want
+        while(low < high)
+        {
+            uint8_t middle = (low + high) / 2;
+
+            if(_routes[middle].key < key)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+
+        //more than one route only shows up here when their hashes collide
+        for(; low < _routeCount && _routes[low].key == key; low++)
+        {
+            const Route& route = _routes[low];
+
+            if(strcmp(route.method, method) != 0 || strncmp(route.path, path, length) != 0)
+                continue;
+
+            if(wildcard ? strcmp(route.path + length, "*") == 0 : route.path[length] == '\0')
+                return &route;
+        }
+
+        return nullptr;
+    }
+
+    /*
+        FNV-1a of "METHOD path"
+    */
+    uint32_t Router::RouteKey(const char* method, const char* path, size_t length, bool wildcard)
+    {
+        uint32_t hash = 2166136261u;
+
+        for(; *method != '\0'; method++)
+            hash = (hash ^ (uint8_t)*method) * 16777619u;
+
+        hash = (hash ^ ' ') * 16777619u;
+
+        for(size_t i = 0; i < length; i++)
+            hash = (hash ^ (uint8_t)path[i]) * 16777619u;
+
+        if(wildcard)
+            hash = (hash ^ '*') * 16777619u;
+
+        return hash;
     }
 }
\ No newline at end of file
@@ -2,11 +2,79 @@
 #include <WiFi.h>
 #include <vector>
 #include "IController.h"
+#include "Request.h"
+#include "ResponseWriter.h"
+#include "Arena.h"
+#include "Allocations.h"
 using namespace std;
 
+//how many clients can be in flight at once
+#ifndef SIMPLEWEB_MAX_CONNECTIONS
+#define SIMPLEWEB_MAX_CONNECTIONS 4
+#endif
+
+//how many routes can be registered
+#ifndef SIMPLEWEB_MAX_ROUTES
+#define SIMPLEWEB_MAX_ROUTES 16
+#endif
+
 
 namespace SimpleWeb
 {
+    /*
+        A client that has been accepted but not answered yet
+    */
+    struct Connection
+    {
+        bool active = false;
+        WiFiClient client;
+        //requests are read straight into the parser's buffer
+        RequestParser parser;
+        //when the whole request has to be in by
+        unsigned long deadline = 0;
+        //for the request trace
+        unsigned long acceptedMicros = 0;
+        uint32_t acceptedAllocations = 0;
+        uint32_t bytesRead = 0;
+    };
+
+    typedef void (*RouteHandler)(void* context, const Request& request, ResponseWriter& response);
+
+    struct Route
+    {
+        //hash of the method and path, the table is kept sorted by it
+        uint32_t key;
+        const char* method;
+        const char* path;
+        RouteHandler handler;
+        void* context;
+        //order the route was added in, doesn't change as more are added
+        uint8_t id;
+    };
+
+    /*
+        What one request cost, handed to the observer once the response has been written
+    */
+    struct RequestTrace
+    {
+        //nullptr when a controller, or nothing, answered
+        const Route* route;
+        //only valid during the observer call
+        const Request* request;
+        //status sent by the router itself, 0 when a handler wrote the response
+        int status;
+        //from accepting the client to the end of the response
+        uint32_t micros;
+        uint32_t bytesRead;
+        uint32_t bytesWritten;
+        //heap allocations made while the request was in flight, see Allocations
+        uint32_t allocations;
+        //taken from the arena by the handler
+        uint32_t arenaBytes;
+    };
+
+    typedef void (*RequestObserver)(void* context, const RequestTrace& trace);
+
     class Router
     {
         private:
@@ -14,10 +82,35 @@ namespace SimpleWeb
         vector<IController*>  _controllers;
         // Define timeout time in milliseconds (example: 2000ms = 2s)
         long timeoutTime = 2000;
-        // Current time
-        unsigned long currentTime = millis();
-        // Previous time
-        unsigned long previousTime = 0; 
+        Connection _connections[SIMPLEWEB_MAX_CONNECTIONS];
+        //connection that gets serviced first on the next check, so they take turns
+        uint8_t _nextConnection = 0;
+
+        void Accept(unsigned long now);
+        void Service(Connection& connection, unsigned long now);
+        void Close(Connection& connection);
+        const Route* Dispatch(const Request& request);
+
+        //every response goes through here, requests are handled one at a time
+        ResponseWriter _response;
+        //so one arena is enough for every connection, it's reset after each response
+        Arena _arena;
+        void Trace(Connection& connection, const Route* route, int status);
+
+        RequestObserver _observer = nullptr;
+        void* _observerContext = nullptr;
+
+        Route _routes[SIMPLEWEB_MAX_ROUTES];
+        uint8_t _routeCount = 0;
+
+        static uint32_t RouteKey(const char* method, const char* path, size_t length, bool wildcard);
+        const Route* FindRoute(const char* method, const char* path, size_t length, bool wildcard) const;
+
+        template<class T, void (T::*Member)(const Request&, ResponseWriter&)>
+        static void Invoke(void* context, const Request& request, ResponseWriter& response)
+        {
+            (static_cast<T*>(context)->*Member)(request, response);
+        }
 
 
         public:
@@ -26,15 +119,61 @@ namespace SimpleWeb
 
         Router(WiFiServer &server) : _server(server){
             //_server = server;
+            for (uint8_t i = 0; i < SIMPLEWEB_MAX_CONNECTIONS; i++)
+                _connections[i].parser.SetArena(&_arena);
         }
 
+        /*
+            Controllers are asked in the order they were added, after the routes
+        */
         void AddController(IController*  controller)
         {            
             _controllers.push_back(controller);
         }
 
+        //Calls the handler when the method and path of a request match exactly.
+        //A path ending in /* matches any last segment, ex: /CMD/* matches /CMD/12
+        //returns false when the table is full or the route already exists
+        bool AddRoute(const char* method, const char* path, RouteHandler handler, void* context);
+
+        /*
+            Routes to a member function, ex: router.AddRoute<DataController, &DataController::GetData>("GET", "/data", this);
+        */
+        template<class T, void (T::*Member)(const Request&, ResponseWriter&)>
+        bool AddRoute(const char* method, const char* path, T* target)
+        {
+            return AddRoute(method, path, &Invoke<T, Member>, target);
+        }
+
+        /*
+            Gets called with the cost of every request, for benchmarks and metrics
+        */
+        void SetObserver(RequestObserver observer, void* context)
+        {
+            _observer = observer;
+            _observerContext = context;
+        }
+
+        uint8_t RouteCount() const { return _routeCount; }
+
+        const Arena& GetArena() const { return _arena; }
+
+        /*
+            Routes in table order, not the order they were added
+        */
+        const Route& GetRoute(uint8_t index) const { return _routes[index]; }
+
+        /*
+            Binary search of the route table.
+            returns nullptr when nothing matches
+        */
+        const Route* FindRoute(const char* method, const char* path) const;
+
 
-        /*Checks for new clients and handles them*/
+        /*
+            Accepts new clients and services the ones in flight.
+            Never waits on a client, call it as often as possible.
+        */
         void Check();
     };
 }
\ No newline at end of file
@@ -0,0 +1,259 @@
+#pragma once
+#include <Arduino.h>
+#include <WiFi.h>
+#include <atomic>
+#include "Metrics.h"
+
+namespace SimpleWeb
+{
+    /*
+        Keeps the station connected without ever waiting on it.
+        Check() moves a small state machine along: connecting, connected, or backing off before the next
+        attempt. Failed attempts back off exponentially from MIN_BACKOFF to MAX_BACKOFF with +/-25% jitter,
+        so a house full of boards doesn't hammer an access point that is rebooting.
+        The server is re-armed every time the station connects, and again when the WiFi event says it
+        got a new IP without dropping the connection. Everything else keeps running while it's offline, readings still go to
+        the history and the log.
+
+        The status comes from a function that can be swapped out, so the recovery can be driven by a fake
+        on a host.
+    */
+    class WiFiManager : public IMetrics
+    {
+        public:
+        typedef wl_status_t (*StatusSource)();
+
+        //how long one attempt gets before backing off
+        static const unsigned long CONNECT_TIMEOUT = 20000;
+        static const unsigned long MIN_BACKOFF = 1000;
+        static const unsigned long MAX_BACKOFF = 60000;
+
+        enum State
+        {
+            StateIdle,
+            StateConnecting,
+            StateConnected,
+            StateBackoff
+        };
+
+        private:
+        WiFiServer& _server;
+        const char* _ssid;
+        const char* _password;
+        StatusSource _status;
+
+        State _state;
+        //when the state was entered
+        unsigned long _since;
+        unsigned long _retryAt;
+        //failed attempts in a row
+        uint8_t _failures;
+        //when the connection was lost, for the recovery time
+        unsigned long _lostAt;
+        bool _lost;
+        bool _serverArmed;
+        //set by the WiFi event task, taken by Check()
+        std::atomic<bool> _gotIp;
+
+        Counter _connects;
+        Counter _disconnects;
+        Counter _attempts;
+        Counter _serverStarts;
+        Histogram _recoveryTimes;
+
+        static wl_status_t WiFiStatus()
+        {
+            return WiFi.status();
+        }
+
+        static WiFiManager*& Instance()
+        {
+            static WiFiManager* instance = nullptr;
+            return instance;
+        }
+
+        /*
+            Runs on the WiFi event task, only sets a flag for Check()
+        */
+        static void OnEvent(WiFiEvent_t event)
+        {
+            if(event == ARDUINO_EVENT_WIFI_STA_GOT_IP && Instance() != nullptr)
+                Instance()->_gotIp.store(true);
+        }
+
+        void Enter(State state, unsigned long now)
+        {
+            _state = state;
+            _since = now;
+        }
+
+        void Connect(unsigned long now)
+        {
+            Serial.printf("Connecting to %s\n", _ssid);
+            WiFi.begin(_ssid, _password);
+            _attempts.Increment();
+            Enter(StateConnecting, now);
+        }
+
+        void Backoff(unsigned long now)
+        {
+            unsigned long wait = MAX_BACKOFF;
+
+            if(_failures < 16 && (MIN_BACKOFF << _failures) < MAX_BACKOFF)
+                wait = MIN_BACKOFF << _failures;
+
+            //anywhere from 75% to 125% of the wait
+            wait = wait * 3 / 4 + random(wait / 2 + 1);
+
+            if(_failures < 255)
+                _failures++;
+
+            Serial.printf("WiFi not connected, trying again in %lu ms\n", wait);
+            //stop the attempt that's still going so it doesn't race the next one
+            WiFi.disconnect();
+            _retryAt = now + wait;
+            Enter(StateBackoff, now);
+        }
+
+        void StartServer()
+        {
+            if(_serverArmed)
+                return;
+
+            //the old socket may be bound to the last connection, start from a clean one
+            _server.end();
+            _server.begin();
+            _serverArmed = true;
+            _serverStarts.Increment();
+        }
+
+        void Connected(unsigned long now)
+        {
+            Serial.print("WiFi connected, IP address: ");
+            Serial.println(WiFi.localIP());
+            _connects.Increment();
+            _failures = 0;
+
+            if(_lost)
+            {
+                _recoveryTimes.Observe(now - _lostAt);
+                _lost = false;
+            }
+
+            Enter(StateConnected, now);
+            //the event for this connection has been seen, the flag is only for the next one
+            _gotIp.store(false);
+            StartServer();
+        }
+
+        public:
+        WiFiManager(WiFiServer& server, const char* ssid, const char* password, StatusSource status = &WiFiManager::WiFiStatus) :
+            _server(server),
+            _ssid(ssid),
+            _password(password),
+            _status(status),
+            _state(StateIdle),
+            _since(0),
+            _retryAt(0),
+            _failures(0),
+            _lostAt(0),
+            _lost(false),
+            _serverArmed(false),
+            _gotIp(false)
+        {
+            //from a second to an hour, in milliseconds
+            static const uint32_t recoveryBounds[] = {1000, 2500, 5000, 10000, 30000, 60000, 300000, 900000, 3600000};
+            _recoveryTimes.SetBounds(recoveryBounds);
+        }
+
+        /*
+            Starts the first attempt, call once from the task that calls Check()
+        */
+        void Begin()
+        {
+            Instance() = this;
+            WiFi.mode(WIFI_STA);
+            //reconnecting is done here with a backoff, not by the driver
+            WiFi.setAutoReconnect(false);
+            WiFi.onEvent(&WiFiManager::OnEvent);
+            Connect(millis());
+        }
+
+        /*
+            Moves the connection along, never waits. Call as often as possible.
+        */
+        void Check()
+        {
+            unsigned long now = millis();
+            wl_status_t status = _status();
+
+            switch(_state)
+            {
+                case StateConnecting:
+                    if(status == WL_CONNECTED)
+                        Connected(now);
+                    else if(status == WL_CONNECT_FAILED || status == WL_NO_SSID_AVAIL || now - _since >= CONNECT_TIMEOUT)
+                        Backoff(now);
+                    break;
+                case StateConnected:
+                    if(status != WL_CONNECTED)
+                    {
+                        Serial.println("WiFi connection lost");
+                        _disconnects.Increment();
+                        _lost = true;
+                        _lostAt = now;
+                        _serverArmed = false;
+                        //straight back in, the backoff is for when that fails
+                        Connect(now);
+                    }
+                    break;
+                case StateBackoff:
+                    if((long)(now - _retryAt) >= 0)
+                        Connect(now);
+                    break;
+                default:
+                    break;
+            }
+
+            //a new lease while still connected, listen again on the new address
+            if(_gotIp.exchange(false) && _state == StateConnected)
+            {
+                Serial.println("WiFi got a new IP address");
+                _serverArmed = false;
+                StartServer();
+            }
+        }
+
+        bool IsConnected() const
+        {
+            return _state == StateConnected;
+        }
+
+        void WriteMetrics(Print& out)
+        {
+            bool connected = IsConnected();
+
+            out.println("# TYPE wifi_connected gauge");
+            Printf(out, "wifi_connected %u\n", connected ? 1 : 0);
+
+            if(connected)
+            {
+                out.println("# TYPE wifi_rssi_dbm gauge");
+                Printf(out, "wifi_rssi_dbm %i\n", (int)WiFi.RSSI());
+                out.println("# TYPE wifi_connection_seconds gauge");
+                Printf(out, "wifi_connection_seconds %lu\n", (millis() - _since) / 1000);
+            }
+
+            out.println("# TYPE wifi_connects_total counter");
+            Printf(out, "wifi_connects_total %u\n", (unsigned int)_connects.Value());
+            out.println("# TYPE wifi_disconnects_total counter");
+            Printf(out, "wifi_disconnects_total %u\n", (unsigned int)_disconnects.Value());
+            out.println("# TYPE wifi_connect_attempts_total counter");
+            Printf(out, "wifi_connect_attempts_total %u\n", (unsigned int)_attempts.Value());
+            out.println("# TYPE wifi_server_starts_total counter");
+            Printf(out, "wifi_server_starts_total %u\n", (unsigned int)_serverStarts.Value());
+            out.println("# TYPE wifi_recovery_duration_milliseconds histogram");
+            _recoveryTimes.Write(out, "wifi_recovery_duration_milliseconds", "");
+        }
+    };
+}
@@ -0,0 +1,350 @@
+#include <Arduino.h>
+
+static std::atomic<uint64_t> now(0);
+static bool verbose = false;
+static uint32_t seed = 1;
+
+HardwareSerial Serial;
+EspClass ESP;
+
+namespace Fake
+{
+    uint64_t Now()
+    {
+        return now.load();
+    }
+
+    void SetNow(uint64_t micros)
+    {
+        now.store(micros);
+    }
+
+    void Advance(unsigned long milliseconds)
+    {
+        now.fetch_add((uint64_t)milliseconds * 1000);
+    }
+
+    void SetVerbose(bool value)
+    {
+        verbose = value;
+    }
+}
+
+unsigned long millis()
+{
+    return (unsigned long)(Fake::Now() / 1000);
+}
+
+unsigned long micros()
+{
+    return (unsigned long)Fake::Now();
+}
+
+void delay(unsigned long milliseconds)
+{
+    Fake::Advance(milliseconds);
+}
+
+void yield()
+{
+}
+
+int64_t esp_timer_get_time()
+{
+    return (int64_t)Fake::Now();
+}
+
+//xorshift, the same sequence on every host so a failing run can be repeated
+long random(long howbig)
+{
+    if(howbig <= 0)
+        return 0;
+
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed % howbig;
+}
+
+long random(long howsmall, long howbig)
+{
+    if(howsmall >= howbig)
+        return howsmall;
+
+    return howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long value)
+{
+    seed = value == 0 ? 1 : (uint32_t)value;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    static thread_local char task;
+    return &task;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    return 4096;
+}
+
+BaseType_t xPortGetCoreID()
+{
+    return 1;
+}
+
+size_t Print::write(const uint8_t* buffer, size_t size)
+{
+    size_t written = 0;
+
+    while(size-- > 0)
+        written += write(*buffer++);
+
+    return written;
+}
+
+size_t Print::printf(const char* format, ...)
+{
+    char stackBuffer[64];
+    char* buffer = stackBuffer;
+    va_list arguments;
+    va_list copy;
+    va_start(arguments, format);
+    va_copy(copy, arguments);
+    int length = vsnprintf(buffer, sizeof(stackBuffer), format, copy);
+    va_end(copy);
+
+    if(length < 0)
+    {
+        va_end(arguments);
+        return 0;
+    }
+
+    if(length >= (int)sizeof(stackBuffer))
+    {
+        buffer = (char*)malloc(length + 1);
+
+        if(buffer == nullptr)
+        {
+            va_end(arguments);
+            return 0;
+        }
+
+        length = vsnprintf(buffer, length + 1, format, arguments);
+    }
+
+    va_end(arguments);
+    size_t written = write((const uint8_t*)buffer, length);
+
+    if(buffer != stackBuffer)
+        free(buffer);
+
+    return written;
+}
+
+size_t Print::print(const char value[])
+{
+    return write(value);
+}
+
+size_t Print::print(char value)
+{
+    return write((uint8_t)value);
+}
+
+size_t Print::print(int value)
+{
+    return print((long)value);
+}
+
+size_t Print::print(unsigned int value)
+{
+    return print((unsigned long)value);
+}
+
+size_t Print::print(long value)
+{
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), "%ld", value);
+    return write(buffer);
+}
+
+size_t Print::print(unsigned long value)
+{
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), "%lu", value);
+    return write(buffer);
+}
+
+size_t Print::print(double value, int digits)
+{
+    char buffer[48];
+    snprintf(buffer, sizeof(buffer), "%.*f", digits, value);
+    return write(buffer);
+}
+
+size_t Print::print(const Printable& value)
+{
+    return value.printTo(*this);
+}
+
+size_t Print::println()
+{
+    return write("\r\n");
+}
+
+size_t Print::println(const char value[])
+{
+    return print(value) + println();
+}
+
+size_t Print::println(char value)
+{
+    return print(value) + println();
+}
+
+size_t Print::println(int value)
+{
+    return print(value) + println();
+}
+
+size_t Print::println(unsigned int value)
+{
+    return print(value) + println();
+}
+
+size_t Print::println(long value)
+{
+    return print(value) + println();
+}
+
+size_t Print::println(unsigned long value)
+{
+    return print(value) + println();
+}
+
+size_t Print::println(double value, int digits)
+{
+    return print(value, digits) + println();
+}
+
+size_t Print::println(const Printable& value)
+{
+    return print(value) + println();
+}
+
+size_t HardwareSerial::write(uint8_t value)
+{
+    return write(&value, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size)
+{
+    if(verbose)
+        fwrite(buffer, 1, size, stdout);
+
+    return size;
+}
+
+void String::Assign(const char* value, unsigned int length)
+{
+    char* buffer = (char*)malloc(length + 1);
+    memcpy(buffer, value, length);
+    buffer[length] = '\0';
+    free(_buffer);
+    _buffer = buffer;
+    _length = length;
+}
+
+String::String(const char* value) : _buffer(nullptr), _length(0)
+{
+    Assign(value == nullptr ? "" : value, value == nullptr ? 0 : strlen(value));
+}
+
+String::String(const String& other) : _buffer(nullptr), _length(0)
+{
+    Assign(other._buffer, other._length);
+}
+
+String::~String()
+{
+    free(_buffer);
+}
+
+String& String::operator=(const String& other)
+{
+    if(this != &other)
+        Assign(other._buffer, other._length);
+
+    return *this;
+}
+
+String& String::operator+=(char value)
+{
+    char added[2] = {value, '\0'};
+    return *this += added;
+}
+
+String& String::operator+=(const char* value)
+{
+    unsigned int added = strlen(value);
+    char* buffer = (char*)realloc(_buffer, _length + added + 1);
+    memcpy(buffer + _length, value, added + 1);
+    _buffer = buffer;
+    _length += added;
+    return *this;
+}
+
+bool String::operator==(const char* value) const
+{
+    return strcmp(_buffer, value) == 0;
+}
+
+int String::indexOf(const char* value) const
+{
+    const char* found = strstr(_buffer, value);
+    return found == nullptr ? -1 : (int)(found - _buffer);
+}
+
+void String::toUpperCase()
+{
+    for(unsigned int i = 0; i < _length; i++)
+        _buffer[i] = toupper((unsigned char)_buffer[i]);
+}
+
+void String::trim()
+{
+    unsigned int start = 0;
+    unsigned int end = _length;
+
+    while(start < end && isspace((unsigned char)_buffer[start]))
+        start++;
+
+    while(end > start && isspace((unsigned char)_buffer[end - 1]))
+        end--;
+
+    memmove(_buffer, _buffer + start, end - start);
+    _length = end - start;
+    _buffer[_length] = '\0';
+}
+
+String Stream::readStringUntil(char terminator)
+{
+    String result;
+    int value;
+
+    while((value = read()) >= 0 && value != terminator)
+        result += (char)value;
+
+    return result;
+}
@@ -0,0 +1,191 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+#include <atomic>
+#include <algorithm>
+
+/*
+    Host stand-in for the parts of the arduino-esp32 core the firmware uses, for env:native.
+    Time is virtual, it only moves when a test or delay() moves it, so hours of acquisition run in milliseconds.
+    Where the real core allocates (Print::printf, WiFiClient) the fakes allocate the same way, so the
+    allocation counts on the host are the ones the board would see.
+*/
+
+using std::min;
+using std::max;
+
+#define LOW 0x0
+#define HIGH 0x1
+#define INPUT 0x01
+#define OUTPUT 0x03
+
+namespace Fake
+{
+    //microseconds since the fake boot
+    uint64_t Now();
+    void SetNow(uint64_t micros);
+    void Advance(unsigned long milliseconds);
+    //Serial goes to stdout when true, it's dropped otherwise so the test output stays readable
+    void SetVerbose(bool verbose);
+}
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long milliseconds);
+void yield();
+int64_t esp_timer_get_time();
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+class Print;
+
+class Printable
+{
+    public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print& p) const = 0;
+};
+
+class Print
+{
+    public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+
+    size_t write(const char* str)
+    {
+        return str == nullptr ? 0 : write((const uint8_t*)str, strlen(str));
+    }
+
+    size_t write(const char* buffer, size_t size)
+    {
+        return write((const uint8_t*)buffer, size);
+    }
+
+    /*
+        Same as the core, formats on the stack and mallocs when the output is 64 bytes or more
+    */
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+    size_t print(const char value[]);
+    size_t print(char value);
+    size_t print(int value);
+    size_t print(unsigned int value);
+    size_t print(long value);
+    size_t print(unsigned long value);
+    size_t print(double value, int digits = 2);
+    size_t print(const Printable& value);
+
+    size_t println();
+    size_t println(const char value[]);
+    size_t println(char value);
+    size_t println(int value);
+    size_t println(unsigned int value);
+    size_t println(long value);
+    size_t println(unsigned long value);
+    size_t println(double value, int digits = 2);
+    size_t println(const Printable& value);
+};
+
+/*
+    Only what the firmware touches, on the heap like the real one
+*/
+class String
+{
+    private:
+    char* _buffer;
+    unsigned int _length;
+
+    void Assign(const char* value, unsigned int length);
+
+    public:
+    String(const char* value = "");
+    String(const String& other);
+    ~String();
+    String& operator=(const String& other);
+    String& operator+=(char value);
+    String& operator+=(const char* value);
+    bool operator==(const char* value) const;
+
+    const char* c_str() const { return _buffer; }
+    unsigned int length() const { return _length; }
+    int indexOf(const char* value) const;
+    void toUpperCase();
+    void trim();
+};
+
+class Stream : public Print
+{
+    public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() { return -1; }
+    virtual void flush() {}
+    String readStringUntil(char terminator);
+};
+
+class HardwareSerial : public Stream
+{
+    public:
+    void begin(unsigned long baud) {}
+    int available() { return 0; }
+    int read() { return -1; }
+    size_t write(uint8_t value);
+    size_t write(const uint8_t* buffer, size_t size);
+    using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+class EspClass
+{
+    public:
+    uint32_t getFreeHeap() { return 180000; }
+    uint32_t getMinFreeHeap() { return 150000; }
+    uint32_t getMaxAllocHeap() { return 110000; }
+};
+
+extern EspClass ESP;
+
+//FreeRTOS, every thread is a task
+typedef void* TaskHandle_t;
+typedef unsigned int UBaseType_t;
+typedef int BaseType_t;
+
+TaskHandle_t xTaskGetCurrentTaskHandle();
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+BaseType_t xPortGetCoreID();
+
+//a spinlock, the critical sections are only ever a few copies long
+struct portMUX_TYPE
+{
+    std::atomic<bool> locked{false};
+};
+
+#define portMUX_INITIALIZER_UNLOCKED {}
+
+inline void vPortEnterCritical(portMUX_TYPE* mux)
+{
+    while(mux->locked.exchange(true, std::memory_order_acquire))
+    {
+    }
+}
+
+inline void vPortExitCritical(portMUX_TYPE* mux)
+{
+    mux->locked.store(false, std::memory_order_release);
+}
+
+#define portENTER_CRITICAL(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) vPortExitCritical(mux)
@@ -0,0 +1,120 @@
+#include <EzoBus.h>
+#include <math.h>
+
+namespace Fake
+{
+    void EzoBus::Attach(Ezo_board& board)
+    {
+        _boards.push_back(&board);
+
+        for(size_t i = 0; i < _names.size(); i++)
+        {
+            if(board.get_name() != nullptr && _names[i] == board.get_name())
+                _columns[i] = &board;
+        }
+    }
+
+    bool EzoBus::Load(const char* csv)
+    {
+        _columns.clear();
+        _names.clear();
+        _times.clear();
+        _rows.clear();
+        _next = 0;
+
+        const char* line = csv;
+        bool header = true;
+
+        while(*line != '\0')
+        {
+            const char* end = strchr(line, '\n');
+            std::string text(line, end == nullptr ? strlen(line) : end - line);
+            line = end == nullptr ? line + text.size() : end + 1;
+
+            if(!text.empty() && text.back() == '\r')
+                text.pop_back();
+
+            if(text.empty())
+                continue;
+
+            std::vector<std::string> cells;
+            size_t start = 0;
+
+            for(size_t comma = text.find(','); ; comma = text.find(',', start))
+            {
+                cells.push_back(text.substr(start, comma == std::string::npos ? std::string::npos : comma - start));
+
+                if(comma == std::string::npos)
+                    break;
+
+                start = comma + 1;
+            }
+
+            if(header)
+            {
+                if(cells[0] != "time")
+                    return false;
+
+                for(size_t i = 1; i < cells.size(); i++)
+                {
+                    _names.push_back(cells[i]);
+                    _columns.push_back(nullptr);
+
+                    for(Ezo_board* board : _boards)
+                    {
+                        if(board->get_name() != nullptr && cells[i] == board->get_name())
+                            _columns.back() = board;
+                    }
+                }
+
+                header = false;
+                continue;
+            }
+
+            //times go forward, and every row has a cell for each column
+            if(cells.size() != _names.size() + 1 || (!_times.empty() && strtoul(cells[0].c_str(), nullptr, 10) < _times.back()))
+                return false;
+
+            _times.push_back(strtoul(cells[0].c_str(), nullptr, 10));
+            _rows.push_back(std::vector<float>());
+
+            for(size_t i = 1; i < cells.size(); i++)
+                _rows.back().push_back(cells[i].empty() ? NAN : (float)atof(cells[i].c_str()));
+        }
+
+        return !header && !_times.empty();
+    }
+
+    void EzoBus::Update()
+    {
+        unsigned long now = millis();
+
+        for(; _next < _times.size() && _times[_next] <= now; _next++)
+        {
+            for(size_t i = 0; i < _columns.size(); i++)
+            {
+                if(_columns[i] != nullptr && !isnan(_rows[_next][i]))
+                    _columns[i]->SetValue(_rows[_next][i]);
+            }
+        }
+    }
+
+    float EzoBus::ValueAt(const char* name, unsigned long time) const
+    {
+        float value = NAN;
+
+        for(size_t i = 0; i < _names.size(); i++)
+        {
+            if(_names[i] != name)
+                continue;
+
+            for(size_t row = 0; row < _times.size() && _times[row] <= time; row++)
+            {
+                if(!isnan(_rows[row][i]))
+                    value = _rows[row][i];
+            }
+        }
+
+        return value;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <Ezo_i2c.h>
+#include <string>
+#include <vector>
+
+namespace Fake
+{
+    /*
+        Plays recorded readings into the simulated EZO circuits on the fake clock.
+        The CSV has a header of "time" and board names, then one row per recording with the milliseconds
+        since boot, ex:
+            time,PH,ORP,RTD
+            0,7.42,651.2,25.10
+            60000,7.43,,25.12
+        A board reads the last row at or before the fake clock, an empty cell keeps what it had.
+    */
+    class EzoBus
+    {
+        private:
+        std::vector<Ezo_board*> _boards;
+        //board of each column after the time, nullptr when nothing by that name is attached
+        std::vector<Ezo_board*> _columns;
+        std::vector<std::string> _names;
+        std::vector<unsigned long> _times;
+        //NAN for an empty cell
+        std::vector<std::vector<float>> _rows;
+        size_t _next;
+
+        public:
+        EzoBus() : _next(0)
+        {
+        }
+
+        void Attach(Ezo_board& board);
+
+        /*
+            Parses the recording from text.
+            returns false when it isn't a CSV like the one above
+        */
+        bool Load(const char* csv);
+
+        /*
+            Sets every attached board to the row for the fake clock, call as the clock moves
+        */
+        void Update();
+
+        /*
+            What the named board reads at the time, NAN when the recording doesn't have it
+        */
+        float ValueAt(const char* name, unsigned long time) const;
+
+        unsigned long Duration() const { return _times.empty() ? 0 : _times.back(); }
+    };
+}
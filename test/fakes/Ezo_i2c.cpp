@@ -0,0 +1,141 @@
+#include <Ezo_i2c.h>
+
+/*
+    What the probe reads until the test sets something, a pool that's about right
+*/
+static float DefaultValue(const char* name)
+{
+    if(name == nullptr)
+        return 0;
+
+    if(strcmp(name, "PH") == 0)
+        return 7.4;
+
+    if(strcmp(name, "ORP") == 0)
+        return 650;
+
+    if(strcmp(name, "RTD") == 0)
+        return 25;
+
+    return 0;
+}
+
+Ezo_board::Ezo_board(uint8_t address) : Ezo_board(address, nullptr)
+{
+}
+
+Ezo_board::Ezo_board(uint8_t address, const char* name) :
+    _address(address),
+    _name(name),
+    _issuedRead(false),
+    _reading(0),
+    _error(SUCCESS),
+    _value(DefaultValue(name)),
+    _latency(DEFAULT_LATENCY),
+    _jitter(0),
+    _fault(SUCCESS),
+    _faults(0),
+    _pending(false),
+    _readyAt(0),
+    _commands(0),
+    _early(0),
+    _noData(0)
+{
+    _lastCommand[0] = '\0';
+}
+
+bool Ezo_board::IsBusy() const
+{
+    return _pending && Fake::Now() < _readyAt;
+}
+
+void Ezo_board::Command(const char* command, bool read)
+{
+    snprintf(_lastCommand, sizeof(_lastCommand), "%s", command);
+    _issuedRead = read;
+    _pending = true;
+    _readyAt = Fake::Now() + (uint64_t)(_latency + (_jitter == 0 ? 0 : random(_jitter + 1))) * 1000;
+    _commands++;
+}
+
+void Ezo_board::send_cmd(const char* command)
+{
+    Command(command, false);
+}
+
+void Ezo_board::send_read_cmd()
+{
+    Command("r", true);
+}
+
+void Ezo_board::send_cmd_with_num(const char* command, float number, uint8_t decimal_amount)
+{
+    char buffer[RESPONSE_SIZE];
+    snprintf(buffer, sizeof(buffer), "%s%.*f", command, decimal_amount, number);
+    Command(buffer, false);
+}
+
+void Ezo_board::send_read_with_temp_comp(float temperature)
+{
+    char buffer[RESPONSE_SIZE];
+    snprintf(buffer, sizeof(buffer), "rt,%.3f", temperature);
+    Command(buffer, true);
+}
+
+Ezo_board::errors Ezo_board::receive_read_cmd()
+{
+    char buffer[RESPONSE_SIZE];
+    _error = receive_cmd(buffer, sizeof(buffer));
+
+    if(_error == SUCCESS)
+    {
+        if(!_issuedRead)
+            _error = NOT_READ_CMD;
+        else
+            _reading = atof(buffer);
+    }
+
+    return _error;
+}
+
+Ezo_board::errors Ezo_board::receive_cmd(char* sensordata_buffer, const uint8_t buffer_len)
+{
+    sensordata_buffer[0] = '\0';
+
+    if(!_pending)
+    {
+        _noData++;
+        _error = NO_DATA;
+        return _error;
+    }
+
+    if(IsBusy())
+    {
+        _early++;
+        _error = NOT_READY;
+        return _error;
+    }
+
+    if(_faults > 0)
+    {
+        _faults--;
+        _error = _fault;
+
+        //the circuit is still working on it, anything else loses the response
+        if(_fault != NOT_READY)
+            _pending = false;
+
+        return _error;
+    }
+
+    //the circuit only sends its response once
+    _pending = false;
+
+    if(_issuedRead)
+        snprintf(sensordata_buffer, buffer_len, "%.3f", _value);
+    else if(strcasecmp(_lastCommand, "i") == 0)
+        snprintf(sensordata_buffer, buffer_len, "?I,%s,2.16", _name == nullptr ? "" : _name);
+
+    _error = SUCCESS;
+    return _error;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <Arduino.h>
+
+/*
+    Host stand-in for the Atlas Scientific EZO library with the circuit on the other end of the bus
+    simulated. Like the real circuit a command keeps it busy for a while, asking before it's done gets
+    NOT_READY, the response can be collected once and after that there's NO_DATA until the next command.
+    The time is the fake clock from Arduino.h. A test can make the circuit slow, jittery or answer with
+    an error, and Fake::EzoBus replays recorded readings into it.
+*/
+class Ezo_board
+{
+    public:
+    enum errors {SUCCESS, FAIL, NOT_READY, NO_DATA, NOT_READ_CMD};
+
+    //the most a response can be, same as the library's buffer
+    static const uint8_t RESPONSE_SIZE = 32;
+    //processing time when the test doesn't set one, shorter than every read time in Devices.h
+    static const unsigned long DEFAULT_LATENCY = 300;
+
+    private:
+    uint8_t _address;
+    const char* _name;
+
+    //library side
+    bool _issuedRead;
+    float _reading;
+    errors _error;
+
+    //circuit side
+    float _value;
+    unsigned long _latency;
+    //up to this much is added to the latency of each command
+    unsigned long _jitter;
+    //the next responses are this error instead, a NOT_READY leaves the response there
+    errors _fault;
+    uint32_t _faults;
+    //a command is being processed or its response hasn't been collected
+    bool _pending;
+    uint64_t _readyAt;
+    char _lastCommand[RESPONSE_SIZE];
+    uint32_t _commands;
+    //collected while the circuit was still busy
+    uint32_t _early;
+    //collected when there was nothing to collect, the response had been taken already
+    uint32_t _noData;
+
+    void Command(const char* command, bool read);
+
+    public:
+    Ezo_board(uint8_t address);
+    Ezo_board(uint8_t address, const char* name);
+
+    const char* get_name() { return _name; }
+    uint8_t get_address() { return _address; }
+
+    void send_cmd(const char* command);
+    void send_read_cmd();
+    void send_cmd_with_num(const char* command, float number, uint8_t decimal_amount = 3);
+    void send_read_with_temp_comp(float temperature);
+    errors receive_read_cmd();
+    errors receive_cmd(char* sensordata_buffer, const uint8_t buffer_len);
+    bool is_read_poll() { return _issuedRead; }
+    float get_last_received_reading() { return _reading; }
+    errors get_error() { return _error; }
+
+    //test side, not in the real library
+    //what the probe measures from now on
+    void SetValue(float value) { _value = value; }
+    float Value() const { return _value; }
+    //how long the circuit takes to process a command, in milliseconds, plus up to jitter more
+    void SetLatency(unsigned long latency, unsigned long jitter = 0) { _latency = latency; _jitter = jitter; }
+    //the next count responses are the error, like a circuit that's confused or a bus glitch
+    void FailNext(errors error, uint32_t count = 1) { _fault = error; _faults = count; }
+    uint32_t Commands() const { return _commands; }
+    uint32_t EarlyCollects() const { return _early; }
+    uint32_t NoDataCollects() const { return _noData; }
+    const char* LastCommand() const { return _lastCommand; }
+    bool IsBusy() const;
+};
@@ -0,0 +1,4 @@
+#pragma once
+#include <Ezo_i2c.h>
+
+//the print helpers of the real library are only used by the sketch, nothing here needs them
@@ -0,0 +1,305 @@
+#include <FS.h>
+#include <LittleFS.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+fs::LittleFSFS LittleFS;
+
+namespace fs
+{
+    struct FileImpl
+    {
+        FS* fs;
+        std::string path;
+        std::string name;
+        FILE* file;
+        DIR* directory;
+
+        FileImpl() : fs(nullptr), file(nullptr), directory(nullptr)
+        {
+        }
+
+        ~FileImpl()
+        {
+            Close();
+        }
+
+        void Close()
+        {
+            if(file != nullptr)
+                fclose(file);
+
+            if(directory != nullptr)
+                closedir(directory);
+
+            file = nullptr;
+            directory = nullptr;
+        }
+    };
+
+    static size_t Blocks(size_t bytes)
+    {
+        return bytes == 0 ? 1 : (bytes + FS::BLOCK_SIZE - 1) / FS::BLOCK_SIZE;
+    }
+
+    static size_t UsedBlocks(const std::string& directory)
+    {
+        size_t blocks = 0;
+        DIR* entries = opendir(directory.c_str());
+
+        if(entries == nullptr)
+            return 0;
+
+        for(struct dirent* entry = readdir(entries); entry != nullptr; entry = readdir(entries))
+        {
+            if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                continue;
+
+            std::string path = directory + "/" + entry->d_name;
+            struct stat status;
+
+            if(stat(path.c_str(), &status) != 0)
+                continue;
+
+            if(S_ISDIR(status.st_mode))
+                blocks += 1 + UsedBlocks(path);
+            else
+                blocks += Blocks(status.st_size);
+        }
+
+        closedir(entries);
+        return blocks;
+    }
+
+    static void RemoveAll(const std::string& directory)
+    {
+        DIR* entries = opendir(directory.c_str());
+
+        if(entries == nullptr)
+            return;
+
+        for(struct dirent* entry = readdir(entries); entry != nullptr; entry = readdir(entries))
+        {
+            if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                continue;
+
+            std::string path = directory + "/" + entry->d_name;
+            struct stat status;
+
+            if(stat(path.c_str(), &status) == 0 && S_ISDIR(status.st_mode))
+            {
+                RemoveAll(path);
+                ::rmdir(path.c_str());
+            }
+            else
+            {
+                unlink(path.c_str());
+            }
+        }
+
+        closedir(entries);
+    }
+
+    const std::string& FS::Root()
+    {
+        if(_root.empty())
+        {
+            char directory[] = "/tmp/fakefs-XXXXXX";
+
+            if(mkdtemp(directory) != nullptr)
+                _root = directory;
+        }
+
+        return _root;
+    }
+
+    void FS::Wipe()
+    {
+        RemoveAll(Root());
+    }
+
+    size_t FS::Used()
+    {
+        return UsedBlocks(Root()) * BLOCK_SIZE;
+    }
+
+    File FS::open(const char* path, const char* mode, const bool create)
+    {
+        std::string full = Root() + path;
+        std::shared_ptr<FileImpl> impl = std::make_shared<FileImpl>();
+        struct stat status;
+        impl->fs = this;
+        impl->path = path;
+        const char* name = strrchr(path, '/');
+        impl->name = name == nullptr ? path : name + 1;
+
+        if(mode[0] == 'r' && stat(full.c_str(), &status) == 0 && S_ISDIR(status.st_mode))
+        {
+            impl->directory = opendir(full.c_str());
+            return impl->directory == nullptr ? File() : File(impl);
+        }
+
+        impl->file = fopen(full.c_str(), mode[0] == 'a' ? "a+b" : mode[0] == 'w' ? "w+b" : "rb");
+        return impl->file == nullptr ? File() : File(impl);
+    }
+
+    bool FS::exists(const char* path)
+    {
+        struct stat status;
+        return stat((Root() + path).c_str(), &status) == 0;
+    }
+
+    bool FS::remove(const char* path)
+    {
+        return unlink((Root() + path).c_str()) == 0;
+    }
+
+    bool FS::rename(const char* pathFrom, const char* pathTo)
+    {
+        return ::rename((Root() + pathFrom).c_str(), (Root() + pathTo).c_str()) == 0;
+    }
+
+    bool FS::mkdir(const char* path)
+    {
+        return ::mkdir((Root() + path).c_str(), 0777) == 0;
+    }
+
+    bool FS::rmdir(const char* path)
+    {
+        return ::rmdir((Root() + path).c_str()) == 0;
+    }
+
+    size_t File::write(uint8_t value)
+    {
+        return write(&value, 1);
+    }
+
+    /*
+        Writes what fits in the partition, the rest is dropped
+    */
+    size_t File::write(const uint8_t* buffer, size_t size)
+    {
+        if(!_p || _p->file == nullptr)
+            return 0;
+
+        fseek(_p->file, 0, SEEK_END);
+        size_t length = ftell(_p->file);
+        size_t capacity = _p->fs->Capacity() / FS::BLOCK_SIZE * FS::BLOCK_SIZE;
+        size_t used = _p->fs->Used();
+        size_t space = Blocks(length) * FS::BLOCK_SIZE - length;
+
+        if(capacity > used)
+            space += capacity - used;
+
+        if(size > space)
+            size = space;
+
+        size_t written = fwrite(buffer, 1, size, _p->file);
+        fflush(_p->file);
+        return written;
+    }
+
+    int File::available()
+    {
+        return (int)(size() - position());
+    }
+
+    int File::read()
+    {
+        uint8_t value;
+        return read(&value, 1) == 1 ? value : -1;
+    }
+
+    size_t File::read(uint8_t* buffer, size_t size)
+    {
+        if(!_p || _p->file == nullptr)
+            return 0;
+
+        return fread(buffer, 1, size, _p->file);
+    }
+
+    int File::peek()
+    {
+        int value = read();
+
+        if(value >= 0)
+            seek(-1, SeekCur);
+
+        return value;
+    }
+
+    void File::flush()
+    {
+        if(_p && _p->file != nullptr)
+            fflush(_p->file);
+    }
+
+    bool File::seek(uint32_t position, SeekMode mode)
+    {
+        if(!_p || _p->file == nullptr)
+            return false;
+
+        long offset = mode == SeekCur ? (long)(int32_t)position : (long)position;
+        return fseek(_p->file, offset, mode == SeekSet ? SEEK_SET : mode == SeekCur ? SEEK_CUR : SEEK_END) == 0 && (size_t)ftell(_p->file) <= size();
+    }
+
+    size_t File::position() const
+    {
+        return _p && _p->file != nullptr ? ftell(_p->file) : 0;
+    }
+
+    size_t File::size() const
+    {
+        struct stat status;
+
+        if(!_p || _p->file == nullptr || fstat(fileno(_p->file), &status) != 0)
+            return 0;
+
+        return status.st_size;
+    }
+
+    void File::close()
+    {
+        if(_p)
+            _p->Close();
+
+        _p = nullptr;
+    }
+
+    File::operator bool() const
+    {
+        return _p && (_p->file != nullptr || _p->directory != nullptr);
+    }
+
+    const char* File::path() const
+    {
+        return _p ? _p->path.c_str() : nullptr;
+    }
+
+    const char* File::name() const
+    {
+        return _p ? _p->name.c_str() : nullptr;
+    }
+
+    bool File::isDirectory() const
+    {
+        return _p && _p->directory != nullptr;
+    }
+
+    File File::openNextFile(const char* mode)
+    {
+        if(!_p || _p->directory == nullptr)
+            return File();
+
+        for(struct dirent* entry = readdir(_p->directory); entry != nullptr; entry = readdir(_p->directory))
+        {
+            if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                continue;
+
+            return _p->fs->open((_p->path + "/" + entry->d_name).c_str(), mode);
+        }
+
+        return File();
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <Arduino.h>
+#include <memory>
+#include <string>
+
+/*
+    Host stand-in for the arduino-esp32 FS API, backed by a directory on the host.
+    It has a size like a flash partition, space is taken a block at a time and a write that doesn't
+    fit only writes what does, the way a full LittleFS tears the last record.
+*/
+namespace fs
+{
+    enum SeekMode
+    {
+        SeekSet = 0,
+        SeekCur = 1,
+        SeekEnd = 2
+    };
+
+    class FS;
+    struct FileImpl;
+
+    class File : public Stream
+    {
+        private:
+        std::shared_ptr<FileImpl> _p;
+
+        public:
+        File(std::shared_ptr<FileImpl> p = nullptr) : _p(p)
+        {
+        }
+
+        size_t write(uint8_t value);
+        size_t write(const uint8_t* buffer, size_t size);
+        using Print::write;
+        int available();
+        int read();
+        size_t read(uint8_t* buffer, size_t size);
+        int peek();
+        void flush();
+        bool seek(uint32_t position, SeekMode mode = SeekSet);
+        size_t position() const;
+        size_t size() const;
+        void close();
+        operator bool() const;
+        const char* path() const;
+        const char* name() const;
+        bool isDirectory() const;
+        File openNextFile(const char* mode = "r");
+    };
+
+    class FS
+    {
+        private:
+        std::string _root;
+        size_t _capacity;
+
+        public:
+        //the smallest piece of the partition a file takes
+        static const size_t BLOCK_SIZE = 4096;
+
+        FS(size_t capacity) : _capacity(capacity)
+        {
+        }
+
+        virtual ~FS()
+        {
+        }
+
+        File open(const char* path, const char* mode = "r", const bool create = false);
+        bool exists(const char* path);
+        bool remove(const char* path);
+        bool rename(const char* pathFrom, const char* pathTo);
+        bool mkdir(const char* path);
+        bool rmdir(const char* path);
+
+        //test side, not in the real API
+        //where the files are on the host, made the first time it's needed
+        const std::string& Root();
+        //deletes everything
+        void Wipe();
+        void SetCapacity(size_t bytes) { _capacity = bytes; }
+        size_t Capacity() const { return _capacity; }
+        //blocks in use, every file and directory takes at least one
+        size_t Used();
+    };
+}
+
+using fs::File;
+using fs::FS;
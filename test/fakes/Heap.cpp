@@ -0,0 +1,53 @@
+#include <stdlib.h>
+#include <new>
+
+/*
+    On the board new goes through malloc, libstdc++ is linked in statically so the linker's --wrap
+    catches it. The host's libstdc++ is a shared library that calls malloc from inside itself, so send
+    it through malloc from here and it's counted the same way.
+*/
+
+void* operator new(size_t size)
+{
+    void* pointer = malloc(size == 0 ? 1 : size);
+
+    if(pointer == nullptr)
+        throw std::bad_alloc();
+
+    return pointer;
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return malloc(size == 0 ? 1 : size);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t size) noexcept
+{
+    free(pointer);
+}
+
+void operator delete[](void* pointer, size_t size) noexcept
+{
+    free(pointer);
+}
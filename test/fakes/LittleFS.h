@@ -0,0 +1,35 @@
+#pragma once
+#include <FS.h>
+
+namespace fs
+{
+    class LittleFSFS : public FS
+    {
+        public:
+        //the spiffs partition of the default featheresp32 partition table
+        LittleFSFS() : FS(0x160000)
+        {
+        }
+
+        bool begin(bool formatOnFail = false, const char* basePath = "/littlefs", uint8_t maxOpenFiles = 10, const char* partitionLabel = "spiffs")
+        {
+            return !Root().empty();
+        }
+
+        bool format()
+        {
+            Wipe();
+            return true;
+        }
+
+        size_t totalBytes() { return Capacity(); }
+
+        size_t usedBytes() { return Used(); }
+
+        void end()
+        {
+        }
+    };
+}
+
+extern fs::LittleFSFS LittleFS;
@@ -0,0 +1,283 @@
+#include <WiFi.h>
+#include <lwip/sockets.h>
+
+static const size_t SOCKET_COUNT = 16;
+//fake descriptors start here so they can't be mistaken for real ones
+static const int FIRST_FD = 64;
+
+static FakeSocket sockets[SOCKET_COUNT];
+//opened but not accepted yet, oldest first
+static FakeSocket* pending[SOCKET_COUNT];
+static size_t pendingCount = 0;
+
+static wl_status_t stationStatus = WL_DISCONNECTED;
+static WiFiEventCb eventCallback = nullptr;
+static unsigned int begins = 0;
+static unsigned int disconnects = 0;
+
+WiFiClass WiFi;
+
+namespace Fake
+{
+    FakeSocket* Connect(const char* request, size_t length)
+    {
+        for(size_t i = 0; i < SOCKET_COUNT; i++)
+        {
+            FakeSocket& socket = sockets[i];
+
+            if(socket.used)
+                continue;
+
+            socket.fd = FIRST_FD + (int)i;
+            socket.used = true;
+            socket.closed = false;
+            socket.stopped = false;
+            socket.inputLength = 0;
+            socket.readPosition = 0;
+            socket.outputLength = 0;
+            socket.sendSpace = (size_t)-1;
+            socket.rxBuffer = nullptr;
+            Send(&socket, request, length);
+            pending[pendingCount++] = &socket;
+            return &socket;
+        }
+
+        return nullptr;
+    }
+
+    FakeSocket* Connect(const char* request)
+    {
+        return Connect(request, strlen(request));
+    }
+
+    void Send(FakeSocket* socket, const char* data, size_t length)
+    {
+        if(length > FakeSocket::INPUT_SIZE - socket->inputLength)
+            length = FakeSocket::INPUT_SIZE - socket->inputLength;
+
+        memcpy(socket->input + socket->inputLength, data, length);
+        socket->inputLength += length;
+    }
+
+    void Release(FakeSocket* socket)
+    {
+        for(size_t i = 0; i < pendingCount; i++)
+        {
+            if(pending[i] != socket)
+                continue;
+
+            memmove(pending + i, pending + i + 1, (pendingCount - i - 1) * sizeof(pending[0]));
+            pendingCount--;
+            break;
+        }
+
+        free(socket->rxBuffer);
+        socket->rxBuffer = nullptr;
+        socket->used = false;
+    }
+
+    FakeSocket* Socket(int fd)
+    {
+        if(fd < FIRST_FD || fd >= FIRST_FD + (int)SOCKET_COUNT || !sockets[fd - FIRST_FD].used)
+            return nullptr;
+
+        return &sockets[fd - FIRST_FD];
+    }
+
+    void SetWiFiStatus(wl_status_t value)
+    {
+        stationStatus = value;
+    }
+
+    void RaiseWiFiEvent(WiFiEvent_t event)
+    {
+        if(eventCallback != nullptr)
+            eventCallback(event);
+    }
+
+    unsigned int WiFiBegins()
+    {
+        return begins;
+    }
+
+    unsigned int WiFiDisconnects()
+    {
+        return disconnects;
+    }
+}
+
+ssize_t lwip_recv(int s, void* mem, size_t len, int flags)
+{
+    FakeSocket* socket = Fake::Socket(s);
+
+    if(socket == nullptr || socket->stopped)
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    size_t available = socket->inputLength - socket->readPosition;
+
+    if(available == 0 && len > 0)
+    {
+        if(socket->closed)
+            return 0;
+
+        errno = EWOULDBLOCK;
+        return -1;
+    }
+
+    if(len > available)
+        len = available;
+
+    memcpy(mem, socket->input + socket->readPosition, len);
+    socket->readPosition += len;
+    return len;
+}
+
+ssize_t lwip_send(int s, const void* dataptr, size_t size, int flags)
+{
+    FakeSocket* socket = Fake::Socket(s);
+
+    if(socket == nullptr || socket->stopped)
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    if(socket->closed)
+    {
+        errno = EPIPE;
+        return -1;
+    }
+
+    size_t space = FakeSocket::OUTPUT_SIZE - socket->outputLength;
+
+    if(space > socket->sendSpace)
+        space = socket->sendSpace;
+
+    if(space == 0)
+    {
+        errno = EWOULDBLOCK;
+        return -1;
+    }
+
+    if(size > space)
+        size = space;
+
+    memcpy(socket->output + socket->outputLength, dataptr, size);
+    socket->outputLength += size;
+
+    if(socket->sendSpace != (size_t)-1)
+        socket->sendSpace -= size;
+
+    return size;
+}
+
+bool WiFiClient::FillBuffer()
+{
+    if(_socket == nullptr)
+        return false;
+
+    if(_socket->rxBuffer == nullptr)
+        _socket->rxBuffer = (uint8_t*)malloc(FakeSocket::RX_BUFFER_SIZE);
+
+    return _socket->rxBuffer != nullptr;
+}
+
+uint8_t WiFiClient::connected()
+{
+    return _socket != nullptr && !_socket->stopped && !_socket->closed;
+}
+
+int WiFiClient::available()
+{
+    if(!FillBuffer() || _socket->stopped)
+        return 0;
+
+    return (int)(_socket->inputLength - _socket->readPosition);
+}
+
+int WiFiClient::read()
+{
+    uint8_t value;
+    return read(&value, 1) == 1 ? value : -1;
+}
+
+int WiFiClient::read(uint8_t* buffer, size_t size)
+{
+    if(!FillBuffer())
+        return -1;
+
+    ssize_t received = lwip_recv(_socket->fd, buffer, size, MSG_DONTWAIT);
+    return received < 0 ? -1 : (int)received;
+}
+
+int WiFiClient::peek()
+{
+    if(available() <= 0)
+        return -1;
+
+    return (uint8_t)_socket->input[_socket->readPosition];
+}
+
+size_t WiFiClient::write(uint8_t value)
+{
+    return write(&value, 1);
+}
+
+size_t WiFiClient::write(const uint8_t* buffer, size_t size)
+{
+    if(_socket == nullptr)
+        return 0;
+
+    ssize_t sent = lwip_send(_socket->fd, buffer, size, 0);
+    return sent < 0 ? 0 : sent;
+}
+
+void WiFiClient::stop()
+{
+    if(_socket != nullptr)
+        _socket->stopped = true;
+
+    _socket = nullptr;
+}
+
+bool WiFiServer::hasClient()
+{
+    return _listening && pendingCount > 0;
+}
+
+WiFiClient WiFiServer::accept()
+{
+    if(!hasClient())
+        return WiFiClient();
+
+    FakeSocket* socket = pending[0];
+    memmove(pending, pending + 1, (pendingCount - 1) * sizeof(pending[0]));
+    pendingCount--;
+    return WiFiClient(socket);
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* passphrase)
+{
+    begins++;
+    return stationStatus;
+}
+
+bool WiFiClass::disconnect(bool wifioff, bool eraseap)
+{
+    disconnects++;
+    return true;
+}
+
+int WiFiClass::onEvent(WiFiEventCb callback, arduino_event_id_t event)
+{
+    eventCallback = callback;
+    return 1;
+}
+
+wl_status_t WiFiClass::status()
+{
+    return stationStatus;
+}
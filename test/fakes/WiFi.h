@@ -0,0 +1,199 @@
+#pragma once
+#include <Arduino.h>
+
+/*
+    Host stand-in for the arduino-esp32 WiFi library. The station is whatever status the test sets and
+    the server hands out fake connections the test opened with Fake::Connect().
+*/
+
+typedef enum
+{
+    WL_NO_SHIELD = 255,
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum
+{
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} wifi_mode_t;
+
+typedef enum
+{
+    ARDUINO_EVENT_WIFI_READY = 0,
+    ARDUINO_EVENT_WIFI_STA_START = 2,
+    ARDUINO_EVENT_WIFI_STA_STOP = 3,
+    ARDUINO_EVENT_WIFI_STA_CONNECTED = 4,
+    ARDUINO_EVENT_WIFI_STA_DISCONNECTED = 5,
+    ARDUINO_EVENT_WIFI_STA_GOT_IP = 7,
+    ARDUINO_EVENT_WIFI_STA_LOST_IP = 8,
+    ARDUINO_EVENT_MAX = 41
+} arduino_event_id_t;
+
+typedef arduino_event_id_t WiFiEvent_t;
+typedef void (*WiFiEventCb)(arduino_event_id_t event);
+
+class IPAddress : public Printable
+{
+    private:
+    uint8_t _address[4];
+
+    public:
+    IPAddress(uint8_t first = 0, uint8_t second = 0, uint8_t third = 0, uint8_t fourth = 0) : _address{first, second, third, fourth}
+    {
+    }
+
+    uint8_t operator[](int index) const { return _address[index]; }
+
+    size_t printTo(Print& p) const
+    {
+        return p.printf("%u.%u.%u.%u", _address[0], _address[1], _address[2], _address[3]);
+    }
+};
+
+/*
+    The server's end of one fake TCP connection. The test writes the request into input before the
+    server sees it and reads the response out of output. The buffers are fixed so a connection never
+    allocates on its own, only WiFiClient does, where the real one would.
+*/
+struct FakeSocket
+{
+    static const size_t INPUT_SIZE = 4096;
+    static const size_t OUTPUT_SIZE = 65536;
+    //what WiFiClientRxBuffer mallocs the first time the client is read
+    static const size_t RX_BUFFER_SIZE = 1436;
+
+    int fd;
+    bool used;
+    //the peer hung up
+    bool closed;
+    //the server called stop()
+    bool stopped;
+    char input[INPUT_SIZE];
+    size_t inputLength;
+    size_t readPosition;
+    char output[OUTPUT_SIZE];
+    size_t outputLength;
+    //how many more bytes send() takes before it would block, a slow reader
+    size_t sendSpace;
+    uint8_t* rxBuffer;
+};
+
+namespace Fake
+{
+    /*
+        Opens a connection with the request already sent, WiFiServer::available() hands it out next.
+        returns nullptr when every fake socket is in use
+    */
+    FakeSocket* Connect(const char* request, size_t length);
+    FakeSocket* Connect(const char* request);
+    //sends more of the request
+    void Send(FakeSocket* socket, const char* data, size_t length);
+    //hands the socket back for another connection
+    void Release(FakeSocket* socket);
+    FakeSocket* Socket(int fd);
+
+    void SetWiFiStatus(wl_status_t status);
+    //calls the handler registered with WiFi.onEvent(), on the calling thread
+    void RaiseWiFiEvent(WiFiEvent_t event);
+    //how often WiFi.begin() and WiFi.disconnect() were called
+    unsigned int WiFiBegins();
+    unsigned int WiFiDisconnects();
+}
+
+class WiFiClient : public Stream
+{
+    private:
+    FakeSocket* _socket;
+
+    //WiFiClientRxBuffer mallocs its buffer the first time the client is read, not when it's accepted
+    bool FillBuffer();
+
+    public:
+    WiFiClient() : _socket(nullptr)
+    {
+    }
+
+    explicit WiFiClient(FakeSocket* socket) : _socket(socket)
+    {
+    }
+
+    uint8_t connected();
+
+    operator bool()
+    {
+        return connected();
+    }
+
+    int available();
+    int read();
+    int read(uint8_t* buffer, size_t size);
+    int peek();
+    size_t write(uint8_t value);
+    size_t write(const uint8_t* buffer, size_t size);
+    using Print::write;
+    void stop();
+
+    int fd() const
+    {
+        return _socket == nullptr ? -1 : _socket->fd;
+    }
+};
+
+class WiFiServer
+{
+    private:
+    uint16_t _port;
+    bool _listening;
+
+    public:
+    WiFiServer(uint16_t port = 80, uint8_t maxClients = 4) : _port(port), _listening(false)
+    {
+    }
+
+    void begin(uint16_t port = 0)
+    {
+        _listening = true;
+    }
+
+    void end()
+    {
+        _listening = false;
+    }
+
+    bool hasClient();
+    WiFiClient accept();
+
+    WiFiClient available()
+    {
+        return accept();
+    }
+
+    operator bool()
+    {
+        return _listening;
+    }
+};
+
+class WiFiClass
+{
+    public:
+    wl_status_t begin(const char* ssid, const char* passphrase = nullptr);
+    bool disconnect(bool wifioff = false, bool eraseap = false);
+    bool mode(wifi_mode_t mode) { return true; }
+    bool setAutoReconnect(bool autoReconnect) { return true; }
+    int onEvent(WiFiEventCb callback, arduino_event_id_t event = ARDUINO_EVENT_MAX);
+    wl_status_t status();
+    IPAddress localIP() { return IPAddress(192, 168, 2, 106); }
+    int8_t RSSI() { return -60; }
+};
+
+extern WiFiClass WiFi;
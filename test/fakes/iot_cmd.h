@@ -0,0 +1,3 @@
+#pragma once
+
+//the real iot_cmd.h is only used by the sketch, nothing here needs it
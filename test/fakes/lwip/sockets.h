@@ -0,0 +1,14 @@
+#pragma once
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <errno.h>
+
+/*
+    Like lwIP with LWIP_COMPAT_SOCKETS, send() and recv() are the lwip_ calls, here they go to the
+    fake sockets behind WiFiClient instead of the host's network
+*/
+ssize_t lwip_recv(int s, void* mem, size_t len, int flags);
+ssize_t lwip_send(int s, const void* dataptr, size_t size, int flags);
+
+#define recv(s, mem, len, flags) lwip_recv(s, mem, len, flags)
+#define send(s, dataptr, size, flags) lwip_send(s, dataptr, size, flags)
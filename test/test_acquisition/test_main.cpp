@@ -0,0 +1,238 @@
+//a fifth of the responses are swapped for a fault, on top of what the simulated circuits do
+#define SENSORS_FAULT_RATE 20
+
+#include <Arduino.h>
+#include <EzoBus.h>
+#include <unity.h>
+#include <string>
+#include "Sensors/Acquisition.h"
+
+/*
+    The acquisition against simulated EZO circuits on the fake clock: a recorded trace replayed through
+    circuits with jittery processing times, injected faults and circuits that fail on their own
+*/
+
+static Sensors::CommandQueue commands;
+static Sensors::Acquisition acquisition(commands);
+static Fake::EzoBus bus;
+
+//what WriteMetrics() prints, to look up a metric by name
+struct Captured : public Print
+{
+    std::string text;
+
+    size_t write(uint8_t value) override
+    {
+        text += (char)value;
+        return 1;
+    }
+
+    using Print::write;
+};
+
+static uint32_t Metric(const char* name)
+{
+    Captured captured;
+    acquisition.WriteMetrics(captured);
+    std::string line = std::string("\n") + name + " ";
+    size_t at = captured.text.find(line);
+    TEST_ASSERT_TRUE_MESSAGE(at != std::string::npos, name);
+    return strtoul(captured.text.c_str() + at + line.size(), nullptr, 10);
+}
+
+static Ezo_board& Board(uint8_t device)
+{
+    return Sensors::Devices::Board(device);
+}
+
+/*
+    Starts a cycle of every probe each interval for the duration, like loop() with nothing scheduled
+    slower, and calls check(snapshot, start) when one completes
+*/
+template<typename Check>
+static uint32_t Run(unsigned long duration, unsigned long interval, Check check)
+{
+    unsigned long end = millis() + duration;
+    unsigned long next = millis();
+    unsigned long start = 0;
+    uint32_t cycles = 0;
+
+    while((long)(millis() - end) < 0)
+    {
+        bus.Update();
+
+        if(!acquisition.IsRunning() && (long)(millis() - next) >= 0)
+        {
+            start = millis();
+            next = start + interval;
+            acquisition.Start(start, Sensors::ALL_SENSORS);
+        }
+
+        if(acquisition.Tick(millis()))
+        {
+            Sensors::ReadingSnapshot snapshot;
+            memset(&snapshot, 0, sizeof(snapshot));
+            acquisition.GetReadings(snapshot);
+            check(snapshot, start);
+            cycles++;
+        }
+
+        Fake::Advance(10);
+    }
+
+    return cycles;
+}
+
+/*
+    Two hours of a pool after an acid dose, a row a minute
+*/
+static std::string Trace()
+{
+    std::string csv = "time,PH,ORP,RTD\n";
+    char row[64];
+
+    for(unsigned long minute = 0; minute <= 120; minute++)
+    {
+        float ph = minute < 30 ? 7.8 - minute * 0.01 : 7.5;
+        //the RTD only logged every 5 minutes
+        if(minute % 5 == 0)
+            snprintf(row, sizeof(row), "%lu,%.2f,%.1f,%.2f\n", minute * 60000, ph, 640 + minute * 0.5, 25 + minute * 0.01);
+        else
+            snprintf(row, sizeof(row), "%lu,%.2f,%.1f,\n", minute * 60000, ph, 640 + minute * 0.5);
+
+        csv += row;
+    }
+
+    return csv;
+}
+
+void setUp()
+{
+    for(uint8_t i = 0; i < Sensors::DEVICE_COUNT; i++)
+    {
+        Board(i).SetLatency(Ezo_board::DEFAULT_LATENCY);
+        Board(i).FailNext(Ezo_board::SUCCESS, 0);
+    }
+}
+
+void tearDown()
+{
+}
+
+void test_trace_is_read_through_injected_faults()
+{
+    std::string trace = Trace();
+    TEST_ASSERT_TRUE(bus.Load(trace.c_str()));
+
+    //processing times that wander but stay inside the read time of each kind
+    Board(Sensors::DEVICE_PH).SetLatency(500, 350);
+    Board(Sensors::DEVICE_ORP).SetLatency(500, 350);
+    Board(Sensors::DEVICE_RTD).SetLatency(300, 250);
+
+    uint32_t good = 0;
+    uint32_t wrong = 0;
+    uint32_t failed = 0;
+
+    //a minute past the end so every row has been played
+    uint32_t cycles = Run(bus.Duration() + 60000, 5000, [&](const Sensors::ReadingSnapshot& snapshot, unsigned long start)
+    {
+        for(uint8_t i = 0; i < Sensors::SENSOR_COUNT; i++)
+        {
+            if(snapshot.errors[i] != Ezo_board::SUCCESS)
+            {
+                failed++;
+                continue;
+            }
+
+            //the trace can move on a row while the cycle runs
+            const char* name = Sensors::Devices::Info(i).name;
+            float value = snapshot.values[i];
+
+            if(fabsf(value - bus.ValueAt(name, start)) < 0.001 || fabsf(value - bus.ValueAt(name, millis())) < 0.001)
+                good++;
+            else
+                wrong++;
+        }
+    });
+
+    printf("%u cycles, %u good reads, %u failed, %u faults injected\n",
+        (unsigned int)cycles, (unsigned int)good, (unsigned int)failed, (unsigned int)Metric("ezo_injected_faults_total"));
+
+    TEST_ASSERT_EQUAL_UINT32(0, wrong);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, Metric("ezo_injected_faults_total"));
+    //an injected NOT_READY is asked again, only the FAIL and NO_DATA ones cost a read (2/3 of 20%)
+    TEST_ASSERT_GREATER_THAN_UINT32(good / 10, failed);
+    TEST_ASSERT_LESS_THAN_UINT32(good / 5, failed);
+
+    for(uint8_t i = 0; i < Sensors::SENSOR_COUNT; i++)
+    {
+        //an injected fault doesn't take the response off the circuit, so the retry never finds it gone
+        TEST_ASSERT_EQUAL_UINT32(0, Board(i).NoDataCollects());
+        TEST_ASSERT_EQUAL_UINT32(0, Board(i).EarlyCollects());
+    }
+}
+
+void test_slow_circuit_is_asked_again()
+{
+    uint32_t notReady = Metric("ezo_not_ready_total{device=\"ORP\"}");
+    uint32_t good = 0;
+
+    //longer than the ORP read time, the first collect is too early
+    Board(Sensors::DEVICE_ORP).SetLatency(1300);
+    Board(Sensors::DEVICE_ORP).SetValue(702.5);
+
+    Run(60000, 5000, [&](const Sensors::ReadingSnapshot& snapshot, unsigned long start)
+    {
+        if(snapshot.errors[Sensors::SENSOR_ORP] == Ezo_board::SUCCESS)
+        {
+            TEST_ASSERT_FLOAT_WITHIN(0.001, 702.5, snapshot.values[Sensors::SENSOR_ORP]);
+            good++;
+        }
+    });
+
+    TEST_ASSERT_GREATER_THAN_UINT32(0, good);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, Board(Sensors::DEVICE_ORP).EarlyCollects());
+    TEST_ASSERT_GREATER_THAN_UINT32(notReady, Metric("ezo_not_ready_total{device=\"ORP\"}"));
+}
+
+void test_failed_temperature_compensates_at_the_default()
+{
+    Board(Sensors::DEVICE_RTD).SetValue(30);
+    //the RTD circuit answers with FAIL for a while
+    Board(Sensors::DEVICE_RTD).FailNext(Ezo_board::FAIL, 1000);
+
+    Run(5000, 5000, [&](const Sensors::ReadingSnapshot& snapshot, unsigned long start)
+    {
+        TEST_ASSERT_TRUE(snapshot.errors[Sensors::SENSOR_RTD] != Ezo_board::SUCCESS);
+    });
+
+    TEST_ASSERT_FLOAT_WITHIN(0.001, Sensors::Acquisition::DEFAULT_TEMPERATURE, acquisition.Temperature());
+    TEST_ASSERT_EQUAL_STRING("rt,25.000", Board(Sensors::DEVICE_PH).LastCommand());
+
+    //back to normal, PH is compensated with the real temperature again
+    Board(Sensors::DEVICE_RTD).FailNext(Ezo_board::SUCCESS, 0);
+    uint32_t good = 0;
+
+    Run(60000, 5000, [&](const Sensors::ReadingSnapshot& snapshot, unsigned long start)
+    {
+        if(snapshot.errors[Sensors::SENSOR_RTD] == Ezo_board::SUCCESS)
+        {
+            TEST_ASSERT_FLOAT_WITHIN(0.001, 30, acquisition.Temperature());
+            good++;
+        }
+    });
+
+    TEST_ASSERT_GREATER_THAN_UINT32(0, good);
+}
+
+int main(int argc, char** argv)
+{
+    for(uint8_t i = 0; i < Sensors::DEVICE_COUNT; i++)
+        bus.Attach(Board(i));
+
+    UNITY_BEGIN();
+    RUN_TEST(test_trace_is_read_through_injected_faults);
+    RUN_TEST(test_slow_circuit_is_asked_again);
+    RUN_TEST(test_failed_temperature_compensates_at_the_default);
+    return UNITY_END();
+}
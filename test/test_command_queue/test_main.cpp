@@ -0,0 +1,92 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <thread>
+#include "Sensors/CommandQueue.h"
+
+/*
+    A submitter that runs its own jobs, like the dosing controller and the acquisition side, recycling
+    the slots as fast as it can while another thread looks jobs up the way GET /CMD/<id> does
+*/
+
+static const uint32_t JOBS = 500000;
+
+static Sensors::CommandQueue commands;
+static std::atomic<uint32_t> submitted(0);
+//Unity can't fail a test from another thread, the submitter counts and the test checks after the join
+static std::atomic<uint32_t> wrongIds(0);
+
+static void Submit()
+{
+    char text[Sensors::Job::COMMAND_SIZE];
+
+    for(uint32_t i = 1; i <= JOBS; i++)
+    {
+        //ids go up by one from 1 with a single submitter, so the command can carry its id
+        snprintf(text, sizeof(text), "c%u", (unsigned int)i);
+        uint32_t id = commands.Submit(0, text);
+        Sensors::Job* job = commands.Next(0);
+
+        if(id != i || job == nullptr)
+        {
+            wrongIds++;
+            //lets the reader stop
+            submitted.store(JOBS, std::memory_order_relaxed);
+            break;
+        }
+
+        snprintf(job->response, Sensors::Job::COMMAND_SIZE, "r%u", (unsigned int)i);
+        commands.Complete(*job, Ezo_board::SUCCESS);
+        submitted.store(i, std::memory_order_relaxed);
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_find_never_mixes_two_jobs()
+{
+    uint32_t found = 0;
+    uint32_t mixed = 0;
+    char expected[Sensors::Job::COMMAND_SIZE];
+    Sensors::JobResult result;
+
+    std::thread submitter(Submit);
+
+    while(submitted.load(std::memory_order_relaxed) < JOBS)
+    {
+        //the newest jobs are the ones whose slots are about to be reused
+        uint32_t id = submitted.load(std::memory_order_relaxed) + 1 - SENSORS_COMMAND_QUEUE_SIZE;
+
+        if((int32_t)id <= 0 || !commands.Find(id, result))
+            continue;
+
+        found++;
+        snprintf(expected, sizeof(expected), "c%u", (unsigned int)id);
+
+        if(result.id != id || strcmp(result.command, expected) != 0)
+            mixed++;
+
+        snprintf(expected, sizeof(expected), "r%u", (unsigned int)id);
+
+        if(result.status == Sensors::JobDone && strcmp(result.response, expected) != 0)
+            mixed++;
+    }
+
+    submitter.join();
+    TEST_ASSERT_EQUAL_UINT32(0, wrongIds.load());
+    printf("%u lookups found their job\n", (unsigned int)found);
+    TEST_ASSERT_EQUAL_UINT32(0, mixed);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, found);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_find_never_mixes_two_jobs);
+    return UNITY_END();
+}
@@ -0,0 +1,195 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <unity.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "SimpleWeb/DataController.cpp"
+
+/*
+    Asks for every route that speaks MessagePack once as JSON and once as MessagePack, and compares
+    the size of the bodies and the time to answer. The sensors run on the fake clock first so there
+    are a few hours of history to send.
+*/
+
+struct Route
+{
+    const char* name;
+    const char* path;
+};
+
+static const Route routes[] = {
+    {"/data", "/data"},
+    {"/data?detail=1", "/data?detail=1"},
+    {"/history points", "/history?sensor=PH"},
+    {"/history step", "/history?sensor=ORP&step=600"},
+    {"/schedule", "/schedule"},
+    {"/dosing", "/dosing"},
+    //the command sent before the test starts
+    {"/CMD/1", "/CMD/1"},
+};
+
+static const size_t ROUTE_COUNT = sizeof(routes) / sizeof(routes[0]);
+static const int ROUNDS = 100;
+
+static WiFiServer server(80);
+static SimpleWeb::Router router(server);
+static SimpleWeb::DataController data;
+
+struct Answer
+{
+    size_t body;
+    uint32_t micros;
+    bool parsed;
+};
+
+/*
+    Runs the acquisition side on the fake clock, like loop() does
+*/
+static void RunFor(unsigned long milliseconds)
+{
+    for(unsigned long elapsed = 0; elapsed < milliseconds; elapsed += 10)
+    {
+        data.ReadData();
+        data.Check();
+        Fake::Advance(10);
+    }
+}
+
+/*
+    The body of a response, put back together when it was chunked.
+    returns its length, 0 when the response isn't complete
+*/
+static size_t Body(const FakeSocket* socket, std::vector<char>& body)
+{
+    const char* output = socket->output;
+    const char* end = output + socket->outputLength;
+    const char* start = strstr(output, "\r\n\r\n");
+    body.clear();
+
+    if(start == nullptr)
+        return 0;
+
+    start += 4;
+
+    if(strstr(output, "Transfer-Encoding: chunked") == nullptr || strstr(output, "Transfer-Encoding: chunked") > start)
+    {
+        body.assign(start, end);
+        return body.size();
+    }
+
+    while(start < end)
+    {
+        char* data;
+        size_t length = strtoul(start, &data, 16);
+        data += 2;
+
+        if(length == 0)
+            return body.size();
+
+        body.insert(body.end(), data, data + length);
+        start = data + length + 2;
+    }
+
+    return 0;
+}
+
+static Answer Ask(const char* path, const char* accept)
+{
+    Answer answer = {0, 0, false};
+    char request[256];
+    std::vector<char> body;
+    snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: 192.168.2.106\r\nAccept: %s\r\n\r\n", path, accept);
+
+    FakeSocket* socket = Fake::Connect(request);
+    TEST_ASSERT_NOT_NULL(socket);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for(int i = 0; i < 10 && !socket->stopped; i++)
+        router.Check();
+
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    answer.micros = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    TEST_ASSERT_EQUAL_STRING_LEN_MESSAGE("HTTP/1.1 200", socket->output, 12, path);
+    answer.body = Body(socket, body);
+
+    //both have to be something a client can read back
+    DynamicJsonDocument doc(65536);
+
+    if(strcmp(accept, "application/msgpack") == 0)
+        answer.parsed = !deserializeMsgPack(doc, body.data(), body.size());
+    else
+        answer.parsed = !deserializeJson(doc, body.data(), body.size());
+
+    Fake::Release(socket);
+    return answer;
+}
+
+static uint32_t Median(std::vector<uint32_t>& values)
+{
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_msgpack_is_smaller_than_json()
+{
+    size_t jsonTotal = 0;
+    size_t msgPackTotal = 0;
+
+    printf("%-18s %10s %10s %8s %10s %10s\n", "route", "json B", "msgpack B", "ratio", "json us", "msgpack us");
+
+    for(size_t i = 0; i < ROUTE_COUNT; i++)
+    {
+        std::vector<uint32_t> jsonTimes;
+        std::vector<uint32_t> msgPackTimes;
+        Answer json = {0, 0, false};
+        Answer msgPack = {0, 0, false};
+
+        for(int round = 0; round < ROUNDS; round++)
+        {
+            json = Ask(routes[i].path, "*/*");
+            msgPack = Ask(routes[i].path, "application/msgpack");
+            jsonTimes.push_back(json.micros);
+            msgPackTimes.push_back(msgPack.micros);
+        }
+
+        printf("%-18s %10u %10u %8.2f %10u %10u\n", routes[i].name, (unsigned int)json.body, (unsigned int)msgPack.body,
+            (double)msgPack.body / json.body, (unsigned int)Median(jsonTimes), (unsigned int)Median(msgPackTimes));
+
+        TEST_ASSERT_TRUE_MESSAGE(json.parsed, routes[i].name);
+        TEST_ASSERT_TRUE_MESSAGE(msgPack.parsed, routes[i].name);
+        TEST_ASSERT_LESS_THAN_UINT32_MESSAGE(json.body, msgPack.body, routes[i].name);
+        jsonTotal += json.body;
+        msgPackTotal += msgPack.body;
+    }
+
+    printf("msgpack is %.0f%% of the json bytes\n", 100.0 * msgPackTotal / jsonTotal);
+}
+
+int main(int argc, char** argv)
+{
+    data.AddRoutes(router);
+    server.begin();
+
+    FakeSocket* socket = Fake::Connect("POST /CMD HTTP/1.1\r\nContent-Type: application/json\r\nContent-Length: 25\r\n\r\n{\"device\":\"PH\",\"cmd\":\"i\"}");
+
+    for(int i = 0; i < 10 && !socket->stopped; i++)
+        router.Check();
+
+    Fake::Release(socket);
+    //a few hours so /history has a few thousand points
+    RunFor(3 * 3600000UL);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_msgpack_is_smaller_than_json);
+    return UNITY_END();
+}
@@ -0,0 +1,175 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <vector>
+#include "Sensors/History.h"
+
+/*
+    Appends cycles to the history and checks they decode to what went in, at the scale of each probe
+*/
+
+static std::vector<Sensors::HistorySample> Decode(const Sensors::History& history)
+{
+    std::vector<Sensors::HistorySample> samples;
+    history.Read(0, UINT32_MAX, [&samples](const Sensors::HistorySample& sample) { samples.push_back(sample); });
+    return samples;
+}
+
+static Sensors::ReadingSnapshot Cycle(float ph, float orp, float rtd)
+{
+    Sensors::ReadingSnapshot snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    snapshot.values[Sensors::SENSOR_PH] = ph;
+    snapshot.values[Sensors::SENSOR_ORP] = orp;
+    snapshot.values[Sensors::SENSOR_RTD] = rtd;
+    snapshot.sampled = Sensors::ALL_SENSORS;
+    return snapshot;
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_unplugged_rtd_round_trips()
+{
+    //the RTD reads -1023 when the probe is unplugged, the jump back and forth doesn't fit the short codes
+    static const float rtd[] = {25.0, 25.1, -1023, -1023, 25.2, 25.3};
+    static const size_t COUNT = sizeof(rtd) / sizeof(rtd[0]);
+    static Sensors::History history;
+
+    for(size_t i = 0; i < COUNT; i++)
+        history.Append(10 * (i + 1), Cycle(7.4, 650, rtd[i]));
+
+    std::vector<Sensors::HistorySample> samples = Decode(history);
+    TEST_ASSERT_EQUAL_UINT32(COUNT, samples.size());
+
+    for(size_t i = 0; i < COUNT; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(10 * (i + 1), samples[i].time);
+        TEST_ASSERT_FLOAT_WITHIN(0.001, rtd[i], samples[i].values[Sensors::SENSOR_RTD]);
+        TEST_ASSERT_FLOAT_WITHIN(0.001, 7.4, samples[i].values[Sensors::SENSOR_PH]);
+        TEST_ASSERT_FLOAT_WITHIN(0.001, 650, samples[i].values[Sensors::SENSOR_ORP]);
+    }
+}
+
+void test_jumps_of_every_size_round_trip()
+{
+    //from a few hundredths to the most a value can be, both ways and across a failed read
+    static const float orp[] = {650, 650.5, 640, 900, -900, 20000000, -20000000, NAN, 700, NAN, NAN, 701, 0};
+    static const size_t COUNT = sizeof(orp) / sizeof(orp[0]);
+    static Sensors::History history;
+
+    for(size_t i = 0; i < COUNT; i++)
+    {
+        Sensors::ReadingSnapshot snapshot = Cycle(7.4, orp[i], 25);
+        //a read that failed keeps its last value, the error is what marks it
+        if(isnan(orp[i]))
+        {
+            snapshot.values[Sensors::SENSOR_ORP] = 650;
+            snapshot.errors[Sensors::SENSOR_ORP] = Ezo_board::FAIL;
+        }
+
+        history.Append(10 + i * (i + 1), snapshot);
+    }
+
+    std::vector<Sensors::HistorySample> samples = Decode(history);
+    TEST_ASSERT_EQUAL_UINT32(COUNT, samples.size());
+
+    for(size_t i = 0; i < COUNT; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(10 + i * (i + 1), samples[i].time);
+
+        if(isnan(orp[i]))
+            TEST_ASSERT_TRUE(isnan(samples[i].values[Sensors::SENSOR_ORP]));
+        else
+            TEST_ASSERT_FLOAT_WITHIN(fabsf(orp[i]) * 1e-6 + 0.01, orp[i], samples[i].values[Sensors::SENSOR_ORP]);
+    }
+}
+
+void test_probes_not_read_in_a_cycle_are_missing()
+{
+    static Sensors::History history;
+    //RTD on a slower schedule than the others, it still has its last value in the cycles it's skipped
+    static const bool rtdRead[] = {true, false, false, true, false, true};
+    static const size_t COUNT = sizeof(rtdRead) / sizeof(rtdRead[0]);
+
+    for(size_t i = 0; i < COUNT; i++)
+    {
+        Sensors::ReadingSnapshot snapshot = Cycle(7 + i / 10.0, 650 + i, 25 + i);
+
+        if(!rtdRead[i])
+        {
+            snapshot.sampled &= ~(1 << Sensors::SENSOR_RTD);
+            snapshot.values[Sensors::SENSOR_RTD] = 25 + (i - 1);
+        }
+
+        history.Append(10 * (i + 1), snapshot);
+    }
+
+    std::vector<Sensors::HistorySample> samples = Decode(history);
+    TEST_ASSERT_EQUAL_UINT32(COUNT, samples.size());
+
+    for(size_t i = 0; i < COUNT; i++)
+    {
+        TEST_ASSERT_FLOAT_WITHIN(0.001, 7 + i / 10.0, samples[i].values[Sensors::SENSOR_PH]);
+        TEST_ASSERT_FLOAT_WITHIN(0.001, 650 + i, samples[i].values[Sensors::SENSOR_ORP]);
+
+        if(rtdRead[i])
+            TEST_ASSERT_FLOAT_WITHIN(0.001, 25 + i, samples[i].values[Sensors::SENSOR_RTD]);
+        else
+            TEST_ASSERT_TRUE(isnan(samples[i].values[Sensors::SENSOR_RTD]));
+    }
+}
+
+void test_block_can_start_with_a_partial_cycle()
+{
+    static Sensors::History history;
+    uint32_t time = 0;
+
+    //enough to go through several blocks, with every other block starting on a cycle that skipped PH
+    for(uint32_t i = 0; i < 4000; i++)
+    {
+        Sensors::ReadingSnapshot snapshot = Cycle(7 + (i % 50) / 100.0, 650, 25);
+
+        if(i % 3 == 0)
+            snapshot.sampled = 1 << Sensors::SENSOR_ORP;
+
+        history.Append(time += 10, snapshot);
+    }
+
+    uint32_t checked = 0;
+    uint32_t visited = history.Read(0, UINT32_MAX, [&checked](const Sensors::HistorySample& sample)
+    {
+        uint32_t i = sample.time / 10 - 1;
+
+        if(i % 3 == 0)
+        {
+            TEST_ASSERT_TRUE(isnan(sample.values[Sensors::SENSOR_PH]));
+            TEST_ASSERT_TRUE(isnan(sample.values[Sensors::SENSOR_RTD]));
+        }
+        else
+        {
+            TEST_ASSERT_FLOAT_WITHIN(0.001, 7 + (i % 50) / 100.0, sample.values[Sensors::SENSOR_PH]);
+            TEST_ASSERT_FLOAT_WITHIN(0.001, 25, sample.values[Sensors::SENSOR_RTD]);
+        }
+
+        TEST_ASSERT_FLOAT_WITHIN(0.001, 650, sample.values[Sensors::SENSOR_ORP]);
+        checked++;
+    });
+
+    TEST_ASSERT_GREATER_THAN_UINT32(0, visited);
+    TEST_ASSERT_EQUAL_UINT32(visited, checked);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_unplugged_rtd_round_trips);
+    RUN_TEST(test_jumps_of_every_size_round_trip);
+    RUN_TEST(test_probes_not_read_in_a_cycle_are_missing);
+    RUN_TEST(test_block_can_start_with_a_partial_cycle);
+    return UNITY_END();
+}
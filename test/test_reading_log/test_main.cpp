@@ -0,0 +1,217 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unity.h>
+#include <string>
+#include "Sensors/ReadingLog.h"
+
+/*
+    The reading log on the fake LittleFS, which has a size like the real partition and tears a write
+    that doesn't fit
+*/
+
+static const uint32_t SEGMENT_BYTES = SENSORS_LOG_SEGMENT_RECORDS * sizeof(Sensors::LogRecord);
+
+//what WriteMetrics() prints, to look up a metric by name
+struct Captured : public Print
+{
+    std::string text;
+
+    size_t write(uint8_t value) override
+    {
+        text += (char)value;
+        return 1;
+    }
+
+    using Print::write;
+};
+
+static uint32_t Metric(Sensors::ReadingLog& log, const char* name)
+{
+    Captured captured;
+    log.WriteMetrics(captured);
+    std::string line = std::string("\n") + name + " ";
+    size_t at = captured.text.find(line);
+    TEST_ASSERT_TRUE_MESSAGE(at != std::string::npos, name);
+    return strtoul(captured.text.c_str() + at + line.size(), nullptr, 10);
+}
+
+static void Append(Sensors::ReadingLog& log, uint32_t from, uint32_t to)
+{
+    Sensors::ReadingSnapshot snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+
+    for(uint32_t time = from; time <= to; time++)
+    {
+        snapshot.values[Sensors::SENSOR_PH] = 7 + (time % 100) / 100.0;
+        snapshot.values[Sensors::SENSOR_ORP] = 600 + time % 100;
+        snapshot.values[Sensors::SENSOR_RTD] = 25;
+        snapshot.sampled = Sensors::ALL_SENSORS;
+        log.Append(time, snapshot);
+    }
+
+    log.Flush();
+}
+
+/*
+    Reads everything and checks the times follow on from each other.
+    returns the number of records, the first and last time go in the arguments
+*/
+static uint32_t ReadAll(Sensors::ReadingLog& log, uint32_t& first, uint32_t& last)
+{
+    uint32_t gaps = 0;
+    first = 0;
+    last = 0;
+
+    uint32_t count = log.Read(0, UINT32_MAX, [&](const Sensors::HistorySample& sample)
+    {
+        if(first == 0)
+            first = sample.time;
+        else if(sample.time != last + 1)
+            gaps++;
+
+        last = sample.time;
+    });
+
+    TEST_ASSERT_EQUAL_UINT32(0, gaps);
+    return count;
+}
+
+static uint32_t Files()
+{
+    uint32_t count = 0;
+    File directory = LittleFS.open(SENSORS_LOG_DIRECTORY);
+
+    for(File file = directory.openNextFile(); file; file = directory.openNextFile())
+        count++;
+
+    return count;
+}
+
+void setUp()
+{
+    LittleFS.Wipe();
+    LittleFS.SetCapacity(0x160000);
+}
+
+void tearDown()
+{
+}
+
+void test_segments_fit_the_partition()
+{
+    static Sensors::ReadingLog log;
+    uint32_t first, last;
+    TEST_ASSERT_TRUE(log.Begin(LittleFS, LittleFS.totalBytes()));
+
+    uint32_t limit = Metric(log, "log_segment_limit");
+    TEST_ASSERT_EQUAL_UINT32(LittleFS.totalBytes() * 3 / 4 / SEGMENT_BYTES, limit);
+
+    //more than the partition holds
+    Append(log, 1, (limit + 4) * SENSORS_LOG_SEGMENT_RECORDS);
+
+    TEST_ASSERT_EQUAL_UINT32(0, Metric(log, "log_write_errors_total"));
+    TEST_ASSERT_EQUAL_UINT32(limit, Metric(log, "log_segments"));
+    TEST_ASSERT_EQUAL_UINT32(limit, Files());
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(LittleFS.totalBytes(), LittleFS.usedBytes());
+    TEST_ASSERT_EQUAL_UINT32(limit * SENSORS_LOG_SEGMENT_RECORDS, ReadAll(log, first, last));
+    TEST_ASSERT_EQUAL_UINT32((limit + 4) * SENSORS_LOG_SEGMENT_RECORDS, last);
+}
+
+void test_a_full_partition_drops_the_oldest_and_retries()
+{
+    static Sensors::ReadingLog log;
+    uint32_t first, last;
+    //the partition is much smaller than Begin() was told, as if something else filled it
+    TEST_ASSERT_TRUE(log.Begin(LittleFS, 0x160000));
+    LittleFS.SetCapacity(8 * SEGMENT_BYTES);
+
+    Append(log, 1, 20 * SENSORS_LOG_SEGMENT_RECORDS);
+
+    uint32_t limit = Metric(log, "log_segment_limit");
+    TEST_ASSERT_GREATER_THAN_UINT32(0, Metric(log, "log_write_errors_total"));
+    TEST_ASSERT_LESS_THAN_UINT32(8, limit);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(limit, Files());
+    //nothing was dropped from the newest segments, what was torn went again into the next one
+    ReadAll(log, first, last);
+    TEST_ASSERT_EQUAL_UINT32(20 * SENSORS_LOG_SEGMENT_RECORDS, last);
+
+    //and once it has settled the writes fit
+    uint32_t errors = Metric(log, "log_write_errors_total");
+    Append(log, last + 1, last + 4 * SENSORS_LOG_SEGMENT_RECORDS);
+    TEST_ASSERT_EQUAL_UINT32(errors, Metric(log, "log_write_errors_total"));
+    ReadAll(log, first, last);
+    TEST_ASSERT_EQUAL_UINT32(24 * SENSORS_LOG_SEGMENT_RECORDS, last);
+}
+
+void test_torn_tail_is_dropped_after_a_reboot()
+{
+    uint32_t first, last;
+
+    {
+        static Sensors::ReadingLog log;
+        TEST_ASSERT_TRUE(log.Begin(LittleFS, LittleFS.totalBytes()));
+        Append(log, 1, 100);
+    }
+
+    //the power went out halfway through the next record
+    char path[32];
+    snprintf(path, sizeof(path), SENSORS_LOG_DIRECTORY "/%08u.bin", 1u);
+    File file = LittleFS.open(path, "a");
+    uint8_t half[sizeof(Sensors::LogRecord) / 2] = {101};
+    TEST_ASSERT_EQUAL_UINT32(sizeof(half), file.write(half, sizeof(half)));
+    file.close();
+
+    static Sensors::ReadingLog rebooted;
+    TEST_ASSERT_TRUE(rebooted.Begin(LittleFS, LittleFS.totalBytes()));
+    TEST_ASSERT_EQUAL_UINT32(100, rebooted.LastTime());
+    TEST_ASSERT_GREATER_THAN_UINT32(0, Metric(rebooted, "log_torn_records_total"));
+    TEST_ASSERT_EQUAL_UINT32(100, ReadAll(rebooted, first, last));
+
+    //appending carries on in a new segment after the torn one
+    Append(rebooted, 101, 150);
+    TEST_ASSERT_EQUAL_UINT32(150, ReadAll(rebooted, first, last));
+    TEST_ASSERT_EQUAL_UINT32(1, first);
+    TEST_ASSERT_EQUAL_UINT32(150, last);
+    TEST_ASSERT_EQUAL_UINT32(2, Files());
+
+    static Sensors::ReadingLog again;
+    TEST_ASSERT_TRUE(again.Begin(LittleFS, LittleFS.totalBytes()));
+    TEST_ASSERT_EQUAL_UINT32(150, again.LastTime());
+    TEST_ASSERT_EQUAL_UINT32(150, ReadAll(again, first, last));
+}
+
+void test_probes_not_read_in_a_cycle_are_missing()
+{
+    static Sensors::ReadingLog log;
+    Sensors::ReadingSnapshot snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    TEST_ASSERT_TRUE(log.Begin(LittleFS, LittleFS.totalBytes()));
+
+    for(uint32_t time = 1; time <= 10; time++)
+    {
+        snapshot.values[Sensors::SENSOR_PH] = 7.5;
+        snapshot.values[Sensors::SENSOR_RTD] = 25;
+        snapshot.sampled = time % 2 == 0 ? Sensors::ALL_SENSORS : 1 << Sensors::SENSOR_PH;
+        log.Append(time, snapshot);
+    }
+
+    log.Flush();
+
+    uint32_t visited = log.Read(0, UINT32_MAX, [](const Sensors::HistorySample& sample)
+    {
+        TEST_ASSERT_FLOAT_WITHIN(0.001, 7.5, sample.values[Sensors::SENSOR_PH]);
+        TEST_ASSERT_EQUAL(sample.time % 2 != 0, isnan(sample.values[Sensors::SENSOR_RTD]));
+    });
+
+    TEST_ASSERT_EQUAL_UINT32(10, visited);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_segments_fit_the_partition);
+    RUN_TEST(test_a_full_partition_drops_the_oldest_and_retries);
+    RUN_TEST(test_torn_tail_is_dropped_after_a_reboot);
+    RUN_TEST(test_probes_not_read_in_a_cycle_are_missing);
+    return UNITY_END();
+}
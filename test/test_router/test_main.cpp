@@ -0,0 +1,394 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <unity.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "SimpleWeb/DataController.cpp"
+#include "SimpleWeb/MetricsController.h"
+
+/*
+    Replays requests recorded from a browser, curl and Postman through Router::Check() and the
+    DataController routes, and reports the latency percentiles, bytes written and heap allocations
+    of each, none of them may allocate. The sensors run on the fake clock in between so the data moves
+    like it does on the board.
+*/
+
+struct Recorded
+{
+    const char* name;
+    int status;
+    const char* request;
+};
+
+static const Recorded recorded[] = {
+    {"GET /data", 200,
+        "GET /data HTTP/1.1\r\nHost: 192.168.2.106\r\nUser-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\nAccept-Encoding: gzip, deflate\r\nAccept-Language: en-US,en;q=0.9\r\nConnection: keep-alive\r\n\r\n"},
+    {"GET /data msgpack", 200,
+        "GET /data HTTP/1.1\r\nHost: 192.168.2.106\r\nUser-Agent: curl/8.4.0\r\nAccept: application/msgpack\r\n\r\n"},
+    {"GET /data 304", 304,
+        "GET /data HTTP/1.1\r\nHost: 192.168.2.106\r\nUser-Agent: curl/8.4.0\r\nAccept: */*\r\nIf-None-Match: *\r\n\r\n"},
+    {"GET /data?detail=1", 200,
+        "GET /data?detail=1 HTTP/1.1\r\nHost: 192.168.2.106\r\nUser-Agent: curl/8.4.0\r\nAccept: */*\r\n\r\n"},
+    {"GET /history step", 200,
+        "GET /history?sensor=PH&from=0&to=86400&step=600 HTTP/1.1\r\nHost: 192.168.2.106\r\nUser-Agent: PostmanRuntime/7.36.0\r\nAccept: */*\r\nCache-Control: no-cache\r\n"
+        "Postman-Token: 5d0c8f7e-2b4c-4a39-9a51-0e2b8e6f4c11\r\nAccept-Encoding: gzip, deflate, br\r\nConnection: keep-alive\r\n\r\n"},
+    {"GET /history points", 200,
+        "GET /history?sensor=RTD HTTP/1.1\r\nHost: 192.168.2.106\r\nUser-Agent: curl/8.4.0\r\nAccept: */*\r\n\r\n"},
+    {"GET /schedule", 200,
+        "GET /schedule HTTP/1.1\r\nHost: 192.168.2.106\r\nUser-Agent: curl/8.4.0\r\nAccept: */*\r\n\r\n"},
+    {"POST /schedule", 200,
+        "POST /schedule HTTP/1.1\r\nHost: 192.168.2.106\r\nUser-Agent: PostmanRuntime/7.36.0\r\nContent-Type: application/json\r\nAccept: */*\r\nContent-Length: 40\r\n\r\n"
+        "{\"sensor\":\"ORP\",\"max\":120000,\"min\":5000}"},
+    {"GET /dosing", 200,
+        "GET /dosing HTTP/1.1\r\nHost: 192.168.2.106\r\nUser-Agent: curl/8.4.0\r\nAccept: application/json\r\n\r\n"},
+    {"POST /dosing", 200,
+        "POST /dosing HTTP/1.1\r\nHost: 192.168.2.106\r\nUser-Agent: curl/8.4.0\r\nContent-Type: application/json\r\nAccept: */*\r\nContent-Length: 58\r\n\r\n"
+        "{\"enabled\":false,\"pump\":\"PMPL\",\"dose\":10,\"dailyLimit\":100}"},
+    {"POST /CMD", 202,
+        "POST /CMD HTTP/1.1\r\nHost: 192.168.2.106\r\nUser-Agent: PostmanRuntime/7.36.0\r\nContent-Type: application/json\r\nAccept: */*\r\nContent-Length: 25\r\n\r\n"
+        "{\"device\":\"PH\",\"cmd\":\"i\"}"},
+    //the id of the command posted just before
+    {"GET /CMD/<id>", 200,
+        "GET /CMD/<id> HTTP/1.1\r\nHost: 192.168.2.106\r\nUser-Agent: curl/8.4.0\r\nAccept: */*\r\n\r\n"},
+    {"GET /HELP", 200,
+        "GET /HELP HTTP/1.1\r\nHost: 192.168.2.106\r\nUser-Agent: curl/8.4.0\r\nAccept: */*\r\n\r\n"},
+    {"GET /metrics", 200,
+        "GET /metrics HTTP/1.1\r\nHost: 192.168.2.106\r\nUser-Agent: Prometheus/2.48.0\r\nAccept: application/openmetrics-text;version=1.0.0,text/plain;version=0.0.4;q=0.5,*/*;q=0.1\r\n"
+        "Accept-Encoding: gzip\r\nX-Prometheus-Scrape-Timeout-Seconds: 10\r\n\r\n"},
+    {"GET /favicon.ico", 404,
+        "GET /favicon.ico HTTP/1.1\r\nHost: 192.168.2.106\r\nUser-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+        "Accept: image/avif,image/webp,image/apng,image/svg+xml,image/*,*/*;q=0.8\r\nReferer: http://192.168.2.106/data\r\n\r\n"},
+};
+
+static const size_t RECORDED_COUNT = sizeof(recorded) / sizeof(recorded[0]);
+static const int ROUNDS = 200;
+
+static WiFiServer server(80);
+static SimpleWeb::Router router(server);
+static SimpleWeb::DataController data;
+static SimpleWeb::MetricsController metrics(router);
+
+struct Result
+{
+    int status;
+    size_t bytes;
+    uint32_t allocations;
+    uint32_t micros;
+};
+
+/*
+    Runs the acquisition side on the fake clock, like loop() does
+*/
+static void RunFor(unsigned long milliseconds)
+{
+    for(unsigned long elapsed = 0; elapsed < milliseconds; elapsed += 10)
+    {
+        data.ReadData();
+        data.Check();
+        Fake::Advance(10);
+    }
+}
+
+static int Status(const FakeSocket* socket)
+{
+    if(socket->outputLength < 12 || strncmp(socket->output, "HTTP/1.1 ", 9) != 0)
+        return 0;
+
+    return atoi(socket->output + 9);
+}
+
+/*
+    Sends a request and checks the router until it's answered, the caller releases the socket
+*/
+static FakeSocket* Answer(const char* request)
+{
+    FakeSocket* socket = Fake::Connect(request);
+    TEST_ASSERT_NOT_NULL(socket);
+
+    for(int i = 0; i < 10 && !socket->stopped; i++)
+        router.Check();
+
+    return socket;
+}
+
+//the ETag of GET /data, the cycle it was rendered from
+static uint32_t CurrentTag()
+{
+    FakeSocket* socket = Answer("GET /data HTTP/1.1\r\nHost: 192.168.2.106\r\nAccept: */*\r\n\r\n");
+    socket->output[socket->outputLength] = '\0';
+    const char* etag = strstr(socket->output, "ETag: \"");
+    TEST_ASSERT_NOT_NULL(etag);
+    uint32_t tag = strtoul(etag + 7, nullptr, 10);
+    Fake::Release(socket);
+    return tag;
+}
+
+//from the last POST /CMD response, GET /CMD/<id> asks for it
+static unsigned int lastJob = 0;
+
+/*
+    Sends one request and checks the router until it's answered
+*/
+static Result Replay(const char* recordedRequest)
+{
+    Result result = {0, 0, 0, 0};
+    char request[1024];
+    const char* job = strstr(recordedRequest, "<id>");
+
+    if(job != nullptr)
+        snprintf(request, sizeof(request), "%.*s%u%s", (int)(job - recordedRequest), recordedRequest, lastJob, job + 4);
+    else
+        snprintf(request, sizeof(request), "%s", recordedRequest);
+
+    FakeSocket* socket = Fake::Connect(request);
+    TEST_ASSERT_NOT_NULL(socket);
+
+    uint32_t allocations = SimpleWeb::Allocations::Count();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for(int i = 0; i < 10 && !socket->stopped; i++)
+        router.Check();
+
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+    result.allocations = SimpleWeb::Allocations::Count() - allocations;
+    result.micros = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+    result.status = Status(socket);
+    result.bytes = socket->outputLength;
+
+    const char* id = strstr(socket->output, "{\"id\":");
+
+    if(result.status == 202 && id != nullptr)
+        lastJob = strtoul(id + 6, nullptr, 10);
+
+    Fake::Release(socket);
+    return result;
+}
+
+static uint32_t Percentile(std::vector<uint32_t>& values, int percent)
+{
+    std::sort(values.begin(), values.end());
+    return values[(values.size() - 1) * percent / 100];
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_every_recorded_request_is_answered()
+{
+    for(size_t i = 0; i < RECORDED_COUNT; i++)
+    {
+        Result result = Replay(recorded[i].request);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(recorded[i].status, result.status, recorded[i].name);
+        RunFor(1000);
+    }
+}
+
+/*
+    Nothing on the request path touches the heap, not even the first time. GET /history?source=log isn't
+    here, LittleFS mallocs when a file is opened.
+*/
+void test_requests_dont_allocate()
+{
+    for(size_t i = 0; i < RECORDED_COUNT; i++)
+    {
+        Result result = Replay(recorded[i].request);
+        TEST_ASSERT_EQUAL_INT_MESSAGE(recorded[i].status, result.status, recorded[i].name);
+        TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, result.allocations, recorded[i].name);
+    }
+}
+
+/*
+    POST /CMD with an empty array is its own error, not a batch that's too big
+*/
+void test_empty_batch_is_rejected()
+{
+    FakeSocket* socket = Answer("POST /CMD HTTP/1.1\r\nHost: 192.168.2.106\r\nContent-Type: application/json\r\nContent-Length: 2\r\n\r\n[]");
+    socket->output[socket->outputLength] = '\0';
+    TEST_ASSERT_EQUAL_INT(400, Status(socket));
+    TEST_ASSERT_NOT_NULL(strstr(socket->output, "\"Empty batch\""));
+    TEST_ASSERT_NULL(strstr(socket->output, "\"max\""));
+    Fake::Release(socket);
+}
+
+/*
+    After a reboot the cycle starts again from 0, a poller still holding a since from before it
+    gets the current readings straight away instead of waiting for the cycle to catch up
+*/
+void test_since_ahead_of_the_cycle_is_answered()
+{
+    char request[128];
+    uint32_t tag = CurrentTag();
+    snprintf(request, sizeof(request), "GET /data?since=%u&wait=30000 HTTP/1.1\r\nHost: 192.168.2.106\r\n\r\n", (unsigned int)(tag + 5000));
+    FakeSocket* socket = Answer(request);
+    socket->output[socket->outputLength] = '\0';
+    TEST_ASSERT_EQUAL_INT(200, Status(socket));
+    TEST_ASSERT_TRUE(socket->stopped);
+
+    char etag[24];
+    snprintf(etag, sizeof(etag), "ETag: \"%u\"", (unsigned int)tag);
+    TEST_ASSERT_NOT_NULL(strstr(socket->output, etag));
+    TEST_ASSERT_NOT_NULL(strstr(socket->output, "\r\n\r\n{"));
+    Fake::Release(socket);
+
+    //without wait too
+    snprintf(request, sizeof(request), "GET /data?since=%u HTTP/1.1\r\nHost: 192.168.2.106\r\n\r\n", (unsigned int)(tag + 5000));
+    socket = Answer(request);
+    TEST_ASSERT_EQUAL_INT(200, Status(socket));
+    Fake::Release(socket);
+}
+
+/*
+    The event stream and the long poll keep the client after the handler returns, what they send later
+    from Check() doesn't allocate either
+*/
+void test_held_responses_dont_allocate()
+{
+    FakeSocket* stream = Fake::Connect("GET /stream HTTP/1.1\r\nHost: 192.168.2.106\r\nAccept: text/event-stream\r\n\r\n");
+    char request[128];
+    snprintf(request, sizeof(request), "GET /data?since=%u&wait=60000 HTTP/1.1\r\nHost: 192.168.2.106\r\nAccept: */*\r\n\r\n", (unsigned int)CurrentTag());
+    FakeSocket* poll = Fake::Connect(request);
+    TEST_ASSERT_NOT_NULL(stream);
+    TEST_ASSERT_NOT_NULL(poll);
+
+    uint32_t allocations = SimpleWeb::Allocations::Count();
+
+    for(int i = 0; i < 10; i++)
+        router.Check();
+
+    TEST_ASSERT_EQUAL_UINT32(0, SimpleWeb::Allocations::Count() - allocations);
+    TEST_ASSERT_EQUAL_INT(200, Status(stream));
+    TEST_ASSERT_EQUAL_size_t(0, poll->outputLength);
+
+    //the poll waits for the next cycle, nothing reads one so it times out
+    size_t streamed = stream->outputLength;
+    allocations = SimpleWeb::Allocations::Count();
+
+    for(unsigned long elapsed = 0; elapsed <= SIMPLEWEB_MAX_WAIT && poll->outputLength == 0; elapsed += 10)
+    {
+        data.Check();
+        Fake::Advance(10);
+    }
+
+    TEST_ASSERT_EQUAL_UINT32(0, SimpleWeb::Allocations::Count() - allocations);
+    TEST_ASSERT_EQUAL_INT(304, Status(poll));
+
+    //a new cycle goes out to the stream
+    data.ReadData();
+    RunFor(2000);
+    allocations = SimpleWeb::Allocations::Count();
+    data.Check();
+    TEST_ASSERT_EQUAL_UINT32(0, SimpleWeb::Allocations::Count() - allocations);
+    TEST_ASSERT_TRUE(stream->outputLength > streamed);
+
+    //hang up so the stream lets go of the socket before it's handed out again
+    stream->closed = true;
+
+    for(int i = 0; i < 60 && !stream->stopped; i++)
+        RunFor(1000);
+
+    TEST_ASSERT_TRUE(stream->stopped);
+    Fake::Release(stream);
+    Fake::Release(poll);
+}
+
+/*
+    printf into a response, or a metric line, that's too big for its buffer is cut short and counted
+    rather than given a buffer from the heap
+*/
+void test_oversized_output_is_cut_short()
+{
+    static char line[SIMPLEWEB_RESPONSE_BODY_SIZE + 200];
+    memset(line, 'x', sizeof(line) - 1);
+    line[sizeof(line) - 1] = '\0';
+
+    static SimpleWeb::ResponseWriter writer;
+    FakeSocket* socket = Fake::Connect("");
+    WiFiClient client(socket);
+    uint32_t truncated = SimpleWeb::TruncatedOutput().Value();
+    uint32_t allocations = SimpleWeb::Allocations::Count();
+
+    writer.Reset(client);
+    writer.Begin(200, "text/plain");
+    writer.printf("%s\n", "before");
+    //the body so far goes out as a chunk, then only a buffer full of this one fits
+    TEST_ASSERT_EQUAL_size_t(SIMPLEWEB_RESPONSE_BODY_SIZE, writer.printf("%s", line));
+    //left out whole, half a metric would spoil the scrape
+    TEST_ASSERT_EQUAL_size_t(0, SimpleWeb::Printf(writer, "long_metric{label=\"%s\"} 1\n", line));
+    writer.End();
+
+    TEST_ASSERT_EQUAL_UINT32(0, SimpleWeb::Allocations::Count() - allocations);
+    TEST_ASSERT_EQUAL_UINT32(truncated + 2, SimpleWeb::TruncatedOutput().Value());
+
+    socket->output[socket->outputLength] = '\0';
+    TEST_ASSERT_NOT_NULL(strstr(socket->output, "Transfer-Encoding: chunked"));
+    TEST_ASSERT_NOT_NULL(strstr(socket->output, "\r\n7\r\nbefore\n\r\n"));
+    TEST_ASSERT_NULL(strstr(socket->output, "long_metric"));
+
+    size_t written = 0;
+
+    for(const char* body = strstr(socket->output, "\r\n\r\n"); *body != '\0'; body++)
+        written += *body == 'x' ? 1 : 0;
+
+    TEST_ASSERT_EQUAL_size_t(SIMPLEWEB_RESPONSE_BODY_SIZE, written);
+    Fake::Release(socket);
+}
+
+void test_replay_benchmark()
+{
+    std::vector<uint32_t> times[RECORDED_COUNT];
+    size_t bytes[RECORDED_COUNT] = {};
+    uint32_t allocations[RECORDED_COUNT] = {};
+
+    for(int round = 0; round < ROUNDS; round++)
+    {
+        for(size_t i = 0; i < RECORDED_COUNT; i++)
+        {
+            Result result = Replay(recorded[i].request);
+            TEST_ASSERT_EQUAL_INT_MESSAGE(recorded[i].status, result.status, recorded[i].name);
+            times[i].push_back(result.micros);
+            bytes[i] += result.bytes;
+            allocations[i] += result.allocations;
+        }
+
+        //a cycle's worth of acquisition between rounds, so the commands are sent and the data changes
+        RunFor(2000);
+    }
+
+    printf("%-22s %8s %8s %8s %10s %12s\n", "request", "p50 us", "p90 us", "p99 us", "bytes", "allocations");
+
+    for(size_t i = 0; i < RECORDED_COUNT; i++)
+    {
+        printf("%-22s %8u %8u %8u %10u %12.2f\n", recorded[i].name,
+            (unsigned int)Percentile(times[i], 50), (unsigned int)Percentile(times[i], 90), (unsigned int)Percentile(times[i], 99),
+            (unsigned int)(bytes[i] / ROUNDS), (double)allocations[i] / ROUNDS);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    data.AddRoutes(router);
+    metrics.AddRoutes(router);
+    metrics.AddSource(&data);
+    metrics.AddTask("website", xTaskGetCurrentTaskHandle());
+    SimpleWeb::Allocations::SetTask(xTaskGetCurrentTaskHandle());
+    server.begin();
+    //a few cycles so there's data and history to serve
+    RunFor(30000);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_every_recorded_request_is_answered);
+    RUN_TEST(test_requests_dont_allocate);
+    RUN_TEST(test_held_responses_dont_allocate);
+    RUN_TEST(test_empty_batch_is_rejected);
+    RUN_TEST(test_since_ahead_of_the_cycle_is_answered);
+    RUN_TEST(test_oversized_output_is_cut_short);
+    RUN_TEST(test_replay_benchmark);
+    return UNITY_END();
+}
@@ -0,0 +1,137 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "Sensors/Conditioning.h"
+#include "Sensors/Scheduler.h"
+
+/*
+    The scheduler and the conditioning replayed against a made up ORP trace on a virtual clock,
+    the way DataController runs them after every cycle
+*/
+
+static const unsigned long STEP_AT = 30 * 60000UL;
+static const float BEFORE = 650;
+static const float AFTER = 750;
+
+struct Run
+{
+    Sensors::Conditioning conditioning;
+    Sensors::Scheduler scheduler;
+    //when the filtered ORP first moved after the step and when it got within 5 mV of the new level
+    unsigned long moved;
+    unsigned long settled;
+    uint32_t reads;
+    uint32_t rejectedReads;
+};
+
+/*
+    One cycle a second of virtual time for an hour, with ORP stepping from BEFORE to AFTER at STEP_AT
+*/
+static void Replay(Run& run)
+{
+    run.moved = 0;
+    run.settled = 0;
+    run.reads = 0;
+    run.rejectedReads = 0;
+
+    for(unsigned long now = 0; now < 60 * 60000UL; now += 1000)
+    {
+        uint8_t due = run.scheduler.Due(now);
+
+        if((due & (1 << Sensors::SENSOR_ORP)) == 0)
+            continue;
+
+        Sensors::ReadingSnapshot snapshot;
+        memset(&snapshot, 0, sizeof(snapshot));
+        snapshot.sampled = due;
+        snapshot.values[Sensors::SENSOR_PH] = 7.4;
+        snapshot.values[Sensors::SENSOR_RTD] = 25;
+        snapshot.values[Sensors::SENSOR_ORP] = now < STEP_AT ? BEFORE : AFTER;
+
+        run.conditioning.Add(due, snapshot);
+        run.scheduler.Completed(now, due, snapshot);
+
+        if(now < STEP_AT)
+            continue;
+
+        run.reads++;
+
+        if((snapshot.rejected & (1 << Sensors::SENSOR_ORP)) != 0)
+        {
+            run.rejectedReads++;
+            Sensors::ScheduleState state;
+            run.scheduler.GetState(state);
+            TEST_ASSERT_EQUAL_UINT32(Sensors::Scheduler::DEFAULT_MIN_INTERVAL, state.intervals[Sensors::SENSOR_ORP]);
+        }
+
+        float filtered = snapshot.filtered[Sensors::SENSOR_ORP];
+
+        if(run.moved == 0 && filtered > BEFORE + 1)
+            run.moved = now;
+
+        if(run.settled == 0 && filtered > AFTER - 5)
+            run.settled = now;
+    }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_flat_reading_backs_off_to_the_max()
+{
+    static Sensors::Scheduler scheduler;
+    static Sensors::Conditioning conditioning;
+    Sensors::ScheduleState state;
+
+    for(unsigned long now = 0; now < 10 * 60000UL; now += 1000)
+    {
+        uint8_t due = scheduler.Due(now);
+
+        if(due == 0)
+            continue;
+
+        Sensors::ReadingSnapshot snapshot;
+        memset(&snapshot, 0, sizeof(snapshot));
+        snapshot.sampled = due;
+        snapshot.values[Sensors::SENSOR_PH] = 7.4;
+        snapshot.values[Sensors::SENSOR_ORP] = BEFORE;
+        snapshot.values[Sensors::SENSOR_RTD] = 25;
+        conditioning.Add(due, snapshot);
+        scheduler.Completed(now, due, snapshot);
+    }
+
+    scheduler.GetState(state);
+
+    for(uint8_t i = 0; i < Sensors::SENSOR_COUNT; i++)
+        TEST_ASSERT_EQUAL_UINT32(Sensors::Scheduler::DEFAULT_MAX_INTERVAL, state.intervals[i]);
+}
+
+void test_step_is_confirmed_at_the_min_interval()
+{
+    static Run run;
+    Replay(run);
+
+    printf("step: %u reads thrown out, filtered moved after %lu ms and settled after %lu ms\n",
+        (unsigned int)run.rejectedReads, run.moved - STEP_AT, run.settled - STEP_AT);
+
+    //the first reads of the new level look like outliers against a window of the old one
+    TEST_ASSERT_GREATER_THAN_UINT32(0, run.rejectedReads);
+    TEST_ASSERT_GREATER_THAN_UINT32(STEP_AT - 1, run.moved);
+    TEST_ASSERT_GREATER_THAN_UINT32(STEP_AT - 1, run.settled);
+    //the read that finds the step can be up to a max interval late, confirming it takes a few min intervals,
+    //not a max interval each
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(Sensors::Scheduler::DEFAULT_MAX_INTERVAL + 3 * Sensors::Scheduler::DEFAULT_MIN_INTERVAL, run.moved - STEP_AT);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(Sensors::Scheduler::DEFAULT_MAX_INTERVAL + 15 * Sensors::Scheduler::DEFAULT_MIN_INTERVAL, run.settled - STEP_AT);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_flat_reading_backs_off_to_the_max);
+    RUN_TEST(test_step_is_confirmed_at_the_min_interval);
+    return UNITY_END();
+}
@@ -0,0 +1,150 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <thread>
+#include "Sensors/SeqLock.h"
+#include "Sensors/ReadingSnapshot.h"
+
+/*
+    One writer publishing as fast as it can while a reader on another thread checks that every copy
+    it gets is whole, the way the acquisition side and the web task share a cycle
+*/
+
+static const uint32_t PUBLISHES = 2000000;
+
+static Sensors::SeqLock<Sensors::ReadingSnapshot> readings;
+static std::atomic<bool> writing(false);
+
+//every field follows from the cycle, so a copy that mixes two publishes shows
+static void Fill(Sensors::ReadingSnapshot& snapshot, uint32_t cycle)
+{
+    snapshot.cycle = cycle;
+    snapshot.timestamp = cycle * 3;
+
+    for(uint8_t i = 0; i < Sensors::SENSOR_COUNT; i++)
+    {
+        snapshot.values[i] = (float)(cycle % 100000) + i;
+        snapshot.filtered[i] = -(float)(cycle % 100000) - i;
+        snapshot.errors[i] = (uint8_t)(cycle + i);
+    }
+}
+
+static bool IsWhole(const Sensors::ReadingSnapshot& snapshot)
+{
+    Sensors::ReadingSnapshot expected;
+    memset(&expected, 0, sizeof(expected));
+    Fill(expected, snapshot.cycle);
+
+    if(snapshot.cycle == 0)
+        return snapshot.timestamp == 0;
+
+    return memcmp(&expected, &snapshot, sizeof(snapshot)) == 0;
+}
+
+static void Write()
+{
+    Sensors::ReadingSnapshot snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+
+    for(uint32_t cycle = 1; cycle <= PUBLISHES; cycle++)
+    {
+        Fill(snapshot, cycle);
+        readings.Publish(snapshot);
+    }
+
+    writing.store(false);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_reader_never_sees_a_torn_snapshot()
+{
+    uint32_t reads = 0;
+    uint32_t torn = 0;
+    uint32_t backwards = 0;
+    uint32_t last = 0;
+    Sensors::ReadingSnapshot snapshot;
+
+    writing.store(true);
+    std::thread writer(Write);
+
+    while(writing.load())
+    {
+        readings.Read(snapshot);
+        reads++;
+
+        if(!IsWhole(snapshot))
+            torn++;
+
+        if(snapshot.cycle < last)
+            backwards++;
+
+        last = snapshot.cycle;
+    }
+
+    writer.join();
+    readings.Read(snapshot);
+
+    printf("%u reads during %u publishes\n", (unsigned int)reads, (unsigned int)PUBLISHES);
+    TEST_ASSERT_EQUAL_UINT32(0, torn);
+    TEST_ASSERT_EQUAL_UINT32(0, backwards);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, reads);
+    TEST_ASSERT_EQUAL_UINT32(PUBLISHES, snapshot.cycle);
+    TEST_ASSERT_TRUE(IsWhole(snapshot));
+}
+
+void test_try_read_gives_up_instead_of_waiting()
+{
+    Sensors::SeqLock<Sensors::ReadingSnapshot> lock;
+    Sensors::ReadingSnapshot snapshot;
+    uint32_t failed = 0;
+    uint32_t succeeded = 0;
+    uint32_t torn = 0;
+
+    writing.store(true);
+    std::thread writer([&lock]()
+    {
+        Sensors::ReadingSnapshot published;
+        memset(&published, 0, sizeof(published));
+
+        for(uint32_t cycle = 1; cycle <= PUBLISHES / 4; cycle++)
+        {
+            Fill(published, cycle);
+            lock.Publish(published);
+        }
+
+        writing.store(false);
+    });
+
+    while(writing.load())
+    {
+        if(!lock.TryRead(snapshot))
+        {
+            failed++;
+            continue;
+        }
+
+        succeeded++;
+
+        if(!IsWhole(snapshot))
+            torn++;
+    }
+
+    writer.join();
+    printf("%u reads, %u gave up during a publish\n", (unsigned int)succeeded, (unsigned int)failed);
+    TEST_ASSERT_EQUAL_UINT32(0, torn);
+    TEST_ASSERT_GREATER_THAN_UINT32(0, succeeded);
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_reader_never_sees_a_torn_snapshot);
+    RUN_TEST(test_try_read_gives_up_instead_of_waiting);
+    return UNITY_END();
+}
@@ -0,0 +1,200 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <unity.h>
+#include <string>
+#include "SimpleWeb/WiFiManager.h"
+
+/*
+    The WiFi recovery on the fake clock with the station status coming from the test: the connection
+    dropping, the backoff between attempts, the server coming back and how long it all took, without
+    Check() ever waiting
+*/
+
+using SimpleWeb::WiFiManager;
+
+static wl_status_t station = WL_DISCONNECTED;
+
+static wl_status_t Station()
+{
+    return station;
+}
+
+//what WriteMetrics() prints, to look up a metric by name
+struct Captured : public Print
+{
+    std::string text;
+
+    size_t write(uint8_t value) override
+    {
+        text += (char)value;
+        return 1;
+    }
+
+    using Print::write;
+};
+
+static uint32_t Metric(WiFiManager& wifi, const char* name)
+{
+    Captured captured;
+    wifi.WriteMetrics(captured);
+    std::string line = std::string("\n") + name + " ";
+    size_t at = captured.text.find(line);
+    TEST_ASSERT_TRUE_MESSAGE(at != std::string::npos, name);
+    return strtoul(captured.text.c_str() + at + line.size(), nullptr, 10);
+}
+
+/*
+    Check() never waits, delay() on the fake clock would move millis()
+*/
+static void Check(WiFiManager& wifi)
+{
+    unsigned long before = millis();
+    wifi.Check();
+    TEST_ASSERT_EQUAL_UINT32(before, millis());
+}
+
+/*
+    Calls Check() every 10 ms of virtual time until WiFi.begin() has been called again or the time is up,
+    returns how long that took
+*/
+static unsigned long UntilBegin(WiFiManager& wifi, unsigned long limit)
+{
+    unsigned int begins = Fake::WiFiBegins();
+    unsigned long waited = 0;
+
+    while(Fake::WiFiBegins() == begins && waited < limit)
+    {
+        Fake::Advance(10);
+        waited += 10;
+        Check(wifi);
+    }
+
+    return waited;
+}
+
+void setUp(void)
+{
+    station = WL_DISCONNECTED;
+}
+
+void tearDown(void)
+{
+}
+
+void test_dropped_connection_recovers(void)
+{
+    WiFiServer server(80);
+    WiFiManager wifi(server, "pool", "secret", &Station);
+
+    wifi.Begin();
+    station = WL_CONNECTED;
+    Fake::Advance(10);
+    Check(wifi);
+    TEST_ASSERT_TRUE(wifi.IsConnected());
+    TEST_ASSERT_TRUE((bool)server);
+    TEST_ASSERT_EQUAL_UINT32(1, Metric(wifi, "wifi_server_starts_total"));
+
+    //the access point goes away, the first attempt is made straight away
+    Fake::Advance(60000);
+    station = WL_DISCONNECTED;
+    unsigned long lostAt = millis();
+    unsigned int begins = Fake::WiFiBegins();
+    Check(wifi);
+    TEST_ASSERT_FALSE(wifi.IsConnected());
+    TEST_ASSERT_EQUAL_UINT32(begins + 1, Fake::WiFiBegins());
+    TEST_ASSERT_EQUAL_UINT32(1, Metric(wifi, "wifi_disconnects_total"));
+
+    //that attempt times out and is stopped before backing off
+    unsigned int disconnects = Fake::WiFiDisconnects();
+    Fake::Advance(WiFiManager::CONNECT_TIMEOUT);
+    Check(wifi);
+    TEST_ASSERT_EQUAL_UINT32(disconnects + 1, Fake::WiFiDisconnects());
+
+    //the first backoff is a second, give or take a quarter
+    unsigned long waited = UntilBegin(wifi, 10000);
+    TEST_ASSERT_TRUE(waited >= WiFiManager::MIN_BACKOFF * 3 / 4);
+    TEST_ASSERT_TRUE(waited <= WiFiManager::MIN_BACKOFF * 5 / 4 + 10);
+
+    //the access point is back while that attempt is going
+    Fake::Advance(3000);
+    station = WL_CONNECTED;
+    Check(wifi);
+    TEST_ASSERT_TRUE(wifi.IsConnected());
+    TEST_ASSERT_TRUE((bool)server);
+    TEST_ASSERT_EQUAL_UINT32(2, Metric(wifi, "wifi_server_starts_total"));
+    TEST_ASSERT_EQUAL_UINT32(2, Metric(wifi, "wifi_connects_total"));
+    TEST_ASSERT_EQUAL_UINT32(1, Metric(wifi, "wifi_recovery_duration_milliseconds_count{}"));
+    TEST_ASSERT_EQUAL_UINT32(millis() - lostAt, Metric(wifi, "wifi_recovery_duration_milliseconds_sum{}"));
+}
+
+void test_backoff_doubles_up_to_the_limit(void)
+{
+    WiFiServer server(80);
+    WiFiManager wifi(server, "pool", "secret", &Station);
+
+    station = WL_CONNECT_FAILED;
+    wifi.Begin();
+
+    //every attempt fails straight away, the wait before the next one doubles until it reaches MAX_BACKOFF
+    unsigned long expected = WiFiManager::MIN_BACKOFF;
+
+    for(uint8_t attempt = 0; attempt < 10; attempt++)
+    {
+        unsigned long waited = UntilBegin(wifi, 2 * WiFiManager::MAX_BACKOFF);
+        char message[48];
+        snprintf(message, sizeof(message), "attempt %u waited %lu ms", attempt, waited);
+        TEST_ASSERT_TRUE_MESSAGE(waited >= expected * 3 / 4, message);
+        TEST_ASSERT_TRUE_MESSAGE(waited <= expected * 5 / 4 + 20, message);
+
+        expected = expected * 2 < WiFiManager::MAX_BACKOFF ? expected * 2 : WiFiManager::MAX_BACKOFF;
+    }
+
+    TEST_ASSERT_FALSE(wifi.IsConnected());
+    TEST_ASSERT_FALSE((bool)server);
+    TEST_ASSERT_EQUAL_UINT32(11, Metric(wifi, "wifi_connect_attempts_total"));
+
+    //a connection resets the backoff
+    station = WL_CONNECTED;
+    UntilBegin(wifi, 2 * WiFiManager::MAX_BACKOFF);
+    Check(wifi);
+    TEST_ASSERT_TRUE(wifi.IsConnected());
+    station = WL_CONNECTION_LOST;
+    Check(wifi);
+    station = WL_CONNECT_FAILED;
+    Check(wifi);
+    unsigned long waited = UntilBegin(wifi, 2 * WiFiManager::MAX_BACKOFF);
+    TEST_ASSERT_TRUE(waited <= WiFiManager::MIN_BACKOFF * 5 / 4 + 10);
+}
+
+void test_new_address_restarts_server(void)
+{
+    WiFiServer server(80);
+    WiFiManager wifi(server, "pool", "secret", &Station);
+
+    station = WL_CONNECTED;
+    wifi.Begin();
+    Check(wifi);
+    TEST_ASSERT_EQUAL_UINT32(1, Metric(wifi, "wifi_server_starts_total"));
+
+    //a new lease without dropping the connection
+    unsigned int begins = Fake::WiFiBegins();
+    Fake::RaiseWiFiEvent(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    Check(wifi);
+    TEST_ASSERT_TRUE(wifi.IsConnected());
+    TEST_ASSERT_EQUAL_UINT32(2, Metric(wifi, "wifi_server_starts_total"));
+    TEST_ASSERT_EQUAL_UINT32(begins, Fake::WiFiBegins());
+    TEST_ASSERT_EQUAL_UINT32(0, Metric(wifi, "wifi_disconnects_total"));
+
+    //the flag is taken once
+    Check(wifi);
+    TEST_ASSERT_EQUAL_UINT32(2, Metric(wifi, "wifi_server_starts_total"));
+}
+
+int main(int argc, char** argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_dropped_connection_recovers);
+    RUN_TEST(test_backoff_doubles_up_to_the_limit);
+    RUN_TEST(test_new_address_restarts_server);
+    return UNITY_END();
+}